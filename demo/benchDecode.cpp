@@ -0,0 +1,155 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "pylike/argparse.h"
+#include "easyvideo/opencv/stream.h"
+#include "easyvideo/videoDecoder.h"
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("demux and decode from memory benchmark parser", argc, argv);
+    parser.add_argument({"-i", "--input"}, "test.mp4", "video file, loaded into memory first");
+    parser.add_argument({"-f", "--format"}, "", "ffmpeg demuxer name, e.g. h264, empty to probe");
+    parser.add_argument({"-n", "--loops"}, 3, "passes over the file");
+    parser.add_argument({"--demux-only"}, STORE_TRUE, "do not decode packets");
+    parser.add_argument({"--raw"}, "", "h264 or hevc: input is an annex-b elementary stream, decoded in chunks without demuxer");
+    parser.add_argument({"--chunk"}, 65536, "bytes per sendPacket with --raw");
+    parser.parse_args();
+    return parser;
+}
+
+// fixed size chunks as they would come from a socket, cut into frames by the decoder
+int benchRaw(std::vector<uint8_t>& data, std::string codec, int chunk, int loops)
+{
+    for (int loop = 0; loop < loops; loop++)
+    {
+        VideoDecoder* decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
+        decoder->setStreamMode(true);
+        // size comes from the stream itself
+        if (decoder->open_codec(0, 0, 25, codec == "hevc" ? CODEC_H265 : CODEC_H264) < 0)
+        {
+            delete decoder;
+            return -1;
+        }
+
+        cv::Mat frame;
+        int64_t frames = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            int size = (int)std::min((size_t)chunk, data.size() - pos);
+            int ret = decoder->sendPacket(data.data() + pos, size);
+            if (ret < 0)
+            {
+                break;
+            }
+            if (ret == DECODE_OK)
+            {
+                pos += size;
+            }
+            while (decoder->receiveFrame(frame) == DECODE_OK)
+            {
+                frames++;
+            }
+        }
+        while (decoder->sendPacket(nullptr, 0) == DECODE_AGAIN)
+        {
+            while (decoder->receiveFrame(frame) == DECODE_OK)
+            {
+                frames++;
+            }
+        }
+        while (decoder->receiveFrame(frame) == DECODE_OK)
+        {
+            frames++;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("pass %d: %lld frames in %.1f ms, %.1f fps\n", loop, (long long)frames, ms, frames * 1000. / ms);
+        delete decoder;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    pystring input = args["input"];
+    pystring format = args["format"];
+    int loops = args["loops"];
+    bool demuxOnly = args["demux-only"];
+    bool decode = !demuxOnly;
+    pystring raw = args["raw"];
+    int chunk = args["chunk"];
+
+    std::ifstream file(std::string(input), std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.empty())
+    {
+        std::cerr << "cannot read " << std::string(input) << std::endl;
+        return -1;
+    }
+    std::cout << std::string(input) << ": " << data.size() / 1024 << " KiB in memory" << std::endl;
+
+    if (!raw.empty())
+    {
+        return benchRaw(data, raw, chunk, loops);
+    }
+
+    // no disk or network in the loop, only demuxer and decoder
+    for (int loop = 0; loop < loops; loop++)
+    {
+        Stream stream;
+        if (stream.openMemory(data.data(), data.size(), format) < 0)
+        {
+            return -1;
+        }
+        VideoDecoder* decoder = nullptr;
+        if (decode)
+        {
+            decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
+            if (decoder->open_codec(stream.width(), stream.height(), stream.fps(), stream.codec_id()) < 0)
+            {
+                return -1;
+            }
+        }
+
+        cv::Mat frame;
+        int64_t packets = 0, frames = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        StreamPacket packet;
+        while (stream.read(packet) == 0)
+        {
+            packets++;
+            if (decoder != nullptr)
+            {
+                decoder->sendPacket(packet.data, packet.size, packet.pts, packet.dts);
+                while (decoder->receiveFrame(frame) == DECODE_OK)
+                {
+                    frames++;
+                }
+            }
+        }
+        if (decoder != nullptr)
+        {
+            decoder->sendPacket(nullptr, 0);
+            while (decoder->receiveFrame(frame) == DECODE_OK)
+            {
+                frames++;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("pass %d: %lld packets, %lld frames in %.1f ms, %.1f fps\n", loop, (long long)packets,
+               (long long)frames, ms, (decode ? frames : packets) * 1000. / ms);
+
+        stream.close();
+        delete decoder;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <chrono>
+#include <functional>
+
+#include <opencv2/opencv.hpp>
+
+#include "pylike/argparse.h"
+#include "easyvideo/utils/yuv2bgr.h"
+#include "easyvideo/utils/resize.h"
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("yuv420 to bgr benchmark parser", argc, argv);
+    parser.add_argument({"--width"}, 1920, "image width");
+    parser.add_argument({"--height"}, 1080, "image height");
+    parser.add_argument({"-n", "--loops"}, 100, "loops of each converter");
+    parser.add_argument({"--letterbox"}, 640, "letterbox size");
+    parser.parse_args();
+    return parser;
+}
+
+// converters used by the decoder before the fixed-point kernels, kept as the reference
+static void legacyYUV420P2BGR(uint8_t* yuv420p, int w, int h, uint8_t* bgr) {
+    int frameSize = w * h;
+    int yIndex = 0;
+    int uIndex = frameSize;
+    int vIndex = frameSize + (frameSize / 4);
+
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            uint8_t Y = yuv420p[yIndex++];
+            uint8_t U = yuv420p[uIndex + (i / 2) * (w / 2) + (j / 2)];
+            uint8_t V = yuv420p[vIndex + (i / 2) * (w / 2) + (j / 2)];
+            int R = 1.164 * (Y - 16) + 1.596 * (V - 128);
+            int G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128);
+            int B = 1.164 * (Y - 16) + 2.018 * (U - 128);
+            R = R < 0 ? 0 : (R > 255 ? 255 : R);
+            G = G < 0 ? 0 : (G > 255 ? 255 : G);
+            B = B < 0 ? 0 : (B > 255 ? 255 : B);
+            bgr[(i * w + j) * 3 + 0] = B;
+            bgr[(i * w + j) * 3 + 1] = G;
+            bgr[(i * w + j) * 3 + 2] = R;
+        }
+    }
+}
+
+static void legacyNV12_2_BGR(uint8_t* nv12, int w, int h, uint8_t* bgr) {
+    int frameSize = w * h;
+    int yIndex = 0;
+    int uvIndex = frameSize;
+
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            uint8_t Y = nv12[yIndex++];
+            uint8_t U = nv12[uvIndex + (i / 2) * w + (j / 2) * 2];
+            uint8_t V = nv12[uvIndex + (i / 2) * w + (j / 2) * 2 + 1];
+            int R = 1.164 * (Y - 16) + 1.596 * (V - 128);
+            int G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128);
+            int B = 1.164 * (Y - 16) + 2.018 * (U - 128);
+            R = R < 0 ? 0 : (R > 255 ? 255 : R);
+            G = G < 0 ? 0 : (G > 255 ? 255 : G);
+            B = B < 0 ? 0 : (B > 255 ? 255 : B);
+            bgr[(i * w + j) * 3 + 0] = B;
+            bgr[(i * w + j) * 3 + 1] = G;
+            bgr[(i * w + j) * 3 + 2] = R;
+        }
+    }
+}
+
+static double timeit(int loops, std::function<void()> func)
+{
+    func();  // warm up
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++)
+    {
+        func();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / loops;
+}
+
+static double maxDiff(const cv::Mat& a, const cv::Mat& b)
+{
+    double diff = 0;
+    cv::Mat d;
+    cv::absdiff(a, b, d);
+    cv::minMaxLoc(d.reshape(1), nullptr, &diff);
+    return diff;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    int w = args["width"];
+    int h = args["height"];
+    int loops = args["loops"];
+    int lb = args["letterbox"];
+    w &= ~1;
+    h &= ~1;
+
+    cv::Mat i420(h * 3 / 2, w, CV_8UC1), nv12(h * 3 / 2, w, CV_8UC1);
+    cv::randu(i420, 0, 256);
+
+    // same picture in nv12 layout
+    i420.rowRange(0, h).copyTo(nv12.rowRange(0, h));
+    uint8_t* u = i420.data + w * h;
+    uint8_t* v = u + w * h / 4;
+    uint8_t* uv = nv12.data + w * h;
+    for (int i = 0; i < w * h / 4; i++)
+    {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+
+    cv::Mat ref(h, w, CV_8UC3), out(h, w, CV_8UC3);
+
+    std::cout << "image size: " << w << "x" << h << ", loops: " << loops << std::endl;
+    printf("%-24s %12s %12s\n", "converter", "i420(ms)", "nv12(ms)");
+
+    double t_i420 = timeit(loops, [&](){legacyYUV420P2BGR(i420.data, w, h, ref.data);});
+    double t_nv12 = timeit(loops, [&](){legacyNV12_2_BGR(nv12.data, w, h, ref.data);});
+    printf("%-24s %12.3f %12.3f\n", "legacy(double)", t_i420, t_nv12);
+
+    t_i420 = timeit(loops, [&](){cv::cvtColor(i420, out, cv::COLOR_YUV2BGR_I420);});
+    t_nv12 = timeit(loops, [&](){cv::cvtColor(nv12, out, cv::COLOR_YUV2BGR_NV12);});
+    printf("%-24s %12.3f %12.3f\n", "cv::cvtColor", t_i420, t_nv12);
+
+    legacyYUV420P2BGR(i420.data, w, h, ref.data);
+    for (int kernel = easyvideo::YUV2BGR_KERNEL_SCALAR; kernel <= easyvideo::YUV2BGR_KERNEL_NEON; kernel++)
+    {
+        if (!easyvideo::setYUV2BGRKernel(kernel)) continue;
+        t_i420 = timeit(loops, [&](){
+            easyvideo::YUV420P2BGR(i420.data, w, u, w / 2, v, w / 2, out.data, out.step, w, h);
+        });
+        double diff = maxDiff(ref, out);
+        t_nv12 = timeit(loops, [&](){
+            easyvideo::NV12_2_BGR(nv12.data, w, uv, w, out.data, out.step, w, h);
+        });
+        std::string name = std::string("easyvideo/") + easyvideo::getYUV2BGRKernelName(kernel);
+        printf("%-24s %12.3f %12.3f   max diff to legacy: %.0f\n", name.c_str(), t_i420, t_nv12, diff);
+    }
+    easyvideo::setYUV2BGRKernel(easyvideo::YUV2BGR_KERNEL_AUTO);
+    std::cout << "auto selected kernel: "
+              << easyvideo::getYUV2BGRKernelName(easyvideo::getYUV2BGRKernel()) << std::endl;
+
+    // convert + static_resize against the fused letterbox
+    cv::Mat lbRef, lbOut(lb, lb, CV_8UC3);
+    float ratioRef = 0, ratio = 0;
+    double t_ref = timeit(loops, [&](){
+        easyvideo::YUV420P2BGR(i420.data, w, u, w / 2, v, w / 2, out.data, out.step, w, h);
+        ratioRef = static_resize(out, lbRef, cv::Size(lb, lb));
+    });
+    double t_fused = timeit(loops, [&](){
+        ratio = easyvideo::letterboxYUV420P2BGR(i420.data, w, u, w / 2, v, w / 2, w, h,
+                                                lbOut.data, lbOut.step, lb, lb);
+    });
+    printf("letterbox %dx%d: convert+static_resize %.3f ms (ratio %.4f), fused %.3f ms (ratio %.4f)\n",
+           lb, lb, t_ref, ratioRef, t_fused, ratio);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "pylike/argparse.h"
+#include "easyvideo/opencv/stream.h"
+#include "easyvideo/videoDecoder.h"
+
+// glibc: every malloc of the process goes through these, ffmpeg's av_malloc included.
+// only calls made while counting is on are counted
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t align, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static std::atomic<bool> counting{false};
+static std::atomic<uint64_t> small_allocs{0}, large_allocs{0}, large_bytes{0};
+
+// packet data and frame planes are large, refs and bookkeeping structs are small
+static const size_t LARGE_ALLOC = 4096;
+
+static void countAlloc(size_t size)
+{
+    if (!counting.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    if (size >= LARGE_ALLOC)
+    {
+        large_allocs++;
+        large_bytes += size;
+    }
+    else
+    {
+        small_allocs++;
+    }
+}
+
+extern "C" void* malloc(size_t size)
+{
+    countAlloc(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+    countAlloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    countAlloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t align, size_t size)
+{
+    countAlloc(size);
+    *ptr = __libc_memalign(align, size);
+    return *ptr == nullptr ? ENOMEM : 0;
+}
+
+extern "C" void* aligned_alloc(size_t align, size_t size)
+{
+    countAlloc(size);
+    return __libc_memalign(align, size);
+}
+
+extern "C" void* memalign(size_t align, size_t size)
+{
+    countAlloc(size);
+    return __libc_memalign(align, size);
+}
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("steady state decoder allocation check parser", argc, argv);
+    parser.add_argument({"-i", "--input"}, "test.mp4", "video file, loaded into memory first");
+    parser.add_argument({"--warmup"}, 50, "frames decoded before counting, pools and buffers fill up");
+    parser.add_argument({"--threads"}, 1, "decoder threads, frame threads allocate outside the counted calls otherwise");
+    parser.parse_args();
+    return parser;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    pystring input = args["input"];
+    int warmup = args["warmup"];
+    int threads = args["threads"];
+
+    std::ifstream file(std::string(input), std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Stream stream;
+    if (data.empty() || stream.openMemory(data.data(), data.size()) < 0)
+    {
+        std::cerr << "cannot open " << std::string(input) << std::endl;
+        return -1;
+    }
+    VideoDecoder* decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
+    decoder->setThreads(threads);
+    if (decoder->open_codec(stream.width(), stream.height(), stream.fps(), stream.codec_id()) < 0)
+    {
+        return -1;
+    }
+
+    // demuxing allocates packets by itself, only the decoder calls are counted
+    cv::Mat frame;
+    int64_t frames = 0, counted = 0;
+    StreamPacket packet;
+    while (stream.read(packet) == 0)
+    {
+        counting = frames >= warmup;
+        decoder->sendPacket(packet.data, packet.size, packet.pts, packet.dts);
+        while (decoder->receiveFrame(frame) == DECODE_OK)
+        {
+            counted += counting ? 1 : 0;
+            frames++;
+        }
+        counting = false;
+    }
+    delete decoder;
+
+    if (counted == 0)
+    {
+        std::cerr << "no frames after " << warmup << " warmup frames" << std::endl;
+        return -1;
+    }
+    printf("%lld frames counted: %.2f small allocations per frame (ffmpeg packet and frame refs), "
+           "%llu large allocations (%llu bytes)\n", (long long)counted, small_allocs / (double)counted,
+           (unsigned long long)large_allocs, (unsigned long long)large_bytes);
+    bool ok = large_allocs == 0;
+    std::cout << (ok ? "passed: no packet or frame sized allocations per frame" : "failed") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <cmath>
+
+#include "pylike/argparse.h"
+#include "easyvideo/utils/lagClock.h"
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("live lag estimate regression check parser", argc, argv);
+    parser.add_argument({"-f", "--fps"}, "25", "frame rate of the simulated camera");
+    parser.parse_args();
+    return parser;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, double lag)
+{
+    std::cout << (ok ? "ok    " : "FAIL  ") << what << " (lag " << lag << " s)" << std::endl;
+    failures += ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    double fps = std::stod(std::string(args["fps"]));
+    double dt = 1. / fps;
+
+    // a camera in real time with 50 ms network delay, then its pts start over at 0
+    easyvideo::LagClock clock;
+    double now = 1000, pts = 500, lag = 0;
+    for (int i = 0; i < 10 * fps; i++, now += dt, pts += dt)
+    {
+        lag = clock.update(pts, now + 0.05);
+    }
+    check(std::fabs(lag) < 0.01, "real time stream has no lag", lag);
+    pts = 0;
+    double maxLag = 0;
+    for (int i = 0; i < 10 * fps; i++, now += dt, pts += dt)
+    {
+        maxLag = std::max(maxLag, clock.update(pts, now + 0.05));
+    }
+    check(maxLag < 0.01, "pts jumping back is not a backlog", maxLag);
+
+    // the network stalls for 3 s, the packets queued meanwhile are a backlog
+    now += 3;
+    lag = clock.update(pts, now + 0.05);
+    check(std::fabs(lag - 3) < 0.1, "3 s behind is seen", lag);
+    for (int i = 0; i < 4 * fps; i++, pts += dt)
+    {
+        // catching up, the queued packets come 10x faster than real time
+        now += dt / 10;
+        lag = clock.update(pts, now + 0.05);
+    }
+    check(lag < 0.01, "caught up", lag);
+
+    // the camera clock runs 0.5% slow for an hour, the lag does not add up
+    maxLag = 0;
+    for (int i = 0; i < 3600 * fps; i++, now += dt, pts += dt * 0.995)
+    {
+        maxLag = std::max(maxLag, clock.update(pts, now + 0.05));
+    }
+    check(maxLag < 0.1, "slow camera clock", maxLag);
+
+    // pts jump far ahead and back to where they were, e.g. a bad packet
+    lag = clock.update(pts + 3600, now + 0.05);
+    now += dt;
+    pts += dt;
+    lag = clock.update(pts, now + 0.05);
+    check(lag < 0.1, "single bad pts", lag);
+
+    std::cout << (failures ? "FAILED" : "PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
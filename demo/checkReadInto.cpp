@@ -0,0 +1,63 @@
+#include <iostream>
+
+#include <opencv2/opencv.hpp>
+
+#include "pylike/argparse.h"
+#include "easyvideo/opencv/streamCapture.h"
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("read() and readInto() buffer contract check parser", argc, argv);
+    parser.add_argument({"-i", "--input"}, "test.mp4", "video file with at least 4 frames");
+    parser.parse_args();
+    return parser;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    std::cout << (ok ? "ok    " : "FAIL  ") << what << std::endl;
+    failures += ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    pystring input = args["input"];
+
+    easyvideo::StreamCapture cap;
+    if (!cap.open(std::string(input), ""))
+    {
+        std::cerr << "cannot open " << std::string(input) << std::endl;
+        return -1;
+    }
+
+    // read(): every frame in its own buffer, kept frames are not overwritten
+    cv::Mat first, frame;
+    check(cap.read(first), "read() gives a frame");
+    cv::Mat kept = first.clone();
+    cv::Mat alias = first;
+    check(cap.read(alias), "read() into a Mat shared with a kept frame");
+    check(alias.data != first.data, "read() allocates a new buffer");
+    check(cv::norm(first, kept, cv::NORM_INF) == 0, "a kept frame is unchanged by the next read()");
+
+    // readInto(): written in place when size and type match
+    cv::Mat buffer(first.size(), first.type());
+    cv::Mat shared = buffer;
+    uchar* data = buffer.data;
+    check(cap.readInto(buffer), "readInto() gives a frame");
+    check(buffer.data == data && shared.data == data, "readInto() writes into the caller's buffer");
+
+    // wrong size: reallocated once to the output size, the old buffer is left to its other owners
+    cv::Mat small(2, 2, first.type(), cv::Scalar::all(7));
+    cv::Mat smallAlias = small;
+    check(cap.readInto(small), "readInto() into a Mat of another size");
+    check(small.size() == first.size() && small.type() == first.type(), "reallocated to the output size and type");
+    check(smallAlias.rows == 2 && smallAlias.at<cv::Vec3b>(0, 0)[0] == 7, "the old buffer is untouched");
+
+    cap.release();
+    std::cout << (failures ? "failed" : "passed") << std::endl;
+    return failures ? 1 : 0;
+}
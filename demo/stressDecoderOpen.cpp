@@ -0,0 +1,76 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "pylike/argparse.h"
+#include "easyvideo/videoDecoder.h"
+
+
+argparse::ArgumentParser get_args(int argc, char** argv)
+{
+    argparse::ArgumentParser parser("concurrent decoder open/close stress parser", argc, argv);
+    parser.add_argument({"-t", "--threads"}, 16, "threads opening decoders at the same time");
+    parser.add_argument({"-n", "--opens"}, 20, "open/close cycles per thread");
+    parser.add_argument({"-d", "--decoder"}, "", "ffmpeg decoder name, e.g. h264_cuvid, empty: selected by codec id");
+    parser.add_argument({"--hevc"}, STORE_TRUE, "h265 instead of h264 when selected by codec id");
+    parser.parse_args();
+    return parser;
+}
+
+// every thread opens and destroys its own decoders, returns failed opens
+static int run(int threads, int opens, std::string name, int codec, double& ms)
+{
+    std::atomic<int> failed{0};
+    std::vector<std::thread> workers;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&]() {
+            for (int k = 0; k < opens; k++)
+            {
+                VideoDecoder* decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
+                int ret = name.empty() ? decoder->open_codec(1920, 1080, 25, codec)
+                                       : decoder->open_codec(1920, 1080, 25, name);
+                if (ret < 0)
+                {
+                    failed++;
+                }
+                delete decoder;
+            }
+        });
+    }
+    for (auto& worker: workers)
+    {
+        worker.join();
+    }
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    auto args = get_args(argc, argv);
+    int threads = args["threads"];
+    int opens = args["opens"];
+    pystring decoder = args["decoder"];
+    bool hevc = args["hevc"];
+    int codec = hevc ? CODEC_H265 : CODEC_H264;
+
+    // the same number of opens, one thread and then all at once
+    double serial_ms = 0, parallel_ms = 0;
+    int failed = run(1, threads * opens, decoder, codec, serial_ms);
+    failed += run(threads, opens, decoder, codec, parallel_ms);
+
+    int total = threads * opens;
+    printf("%d opens: serial %.1f ms (%.2f ms each), %d threads %.1f ms (%.2f ms each), speedup %.2fx\n",
+           total, serial_ms, serial_ms / total, threads, parallel_ms, parallel_ms / total, serial_ms / parallel_ms);
+    if (failed > 0)
+    {
+        std::cout << "failed: " << failed << " opens did not succeed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
@@ -3,20 +3,87 @@
 
 
 #include <opencv2/opencv.hpp>
+#include <chrono>
+#include <stdint.h>
 
 namespace easyvideo
 {
+// steady clock in seconds, the clock of FrameInfo::recvTime
+inline double steadySeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct FrameInfo
+{
+    double pts=-1;          // stream time in seconds, -1 when unknown
+    double recvTime=0;      // steadySeconds() when the data of the frame was received
+    double demuxTime=0;     // ms reading the packet or grabbing from the device
+    double decodeTime=0;    // ms
+    double convertTime=0;   // ms converting to the output format
+    uint64_t id=0;          // 1 for the first frame of the capture, increasing
+    uint64_t dropped=0;     // frames of the source skipped since the previous read
+};
+
+struct Frame
+{
+    cv::Mat image;
+    FrameInfo info;
+};
+
 class BaseCapture
 {
 public:
     BaseCapture() {};
 
-    ~BaseCapture() {release();}
+    // virtual, captures are deleted through BaseCapture* by createCapture users
+    virtual ~BaseCapture() {}
 
     virtual bool open(std::string url, int apiPreference=::cv::CAP_ANY) {return false;}
 
     virtual bool read(::cv::Mat &frame) {return false;}
 
+    // pixels and timing, captures that can not split the stages report the whole read as decodeTime
+    virtual bool read(Frame &frame)
+    {
+        double t0 = steadySeconds();
+        if (!read(frame.image))
+        {
+            return false;
+        }
+        double t1 = steadySeconds();
+        frame.info = FrameInfo();
+        frame.info.recvTime = t1;
+        frame.info.decodeTime = (t1 - t0) * 1000.;
+        frame.info.id = ++frame_id_;
+        return true;
+    }
+
+    /**
+     * decode into caller owned memory. a frame of the output size and type (CV_8UC3, or
+     * CV_8UC1 with height * 3 / 2 rows for I420/NV12 output) is written in place, and other
+     * Mats sharing its data see the new image. any other frame, e.g. empty, of the size before
+     * a resolution change, of another type or a view with padded rows, is reallocated to the
+     * output size and type: its old buffer is left untouched to the Mats still sharing it.
+     * unlike read() the result is never shared with the capture, so callers can rotate their
+     * own buffers. the default copies the read() result
+     */
+    virtual bool readInto(::cv::Mat &frame)
+    {
+        ::cv::Mat image;
+        if (!read(image))
+        {
+            return false;
+        }
+        // copyTo would write into a view of the same size in place
+        if (!frame.isContinuous())
+        {
+            frame.release();
+        }
+        image.copyTo(frame);
+        return true;
+    }
+
     virtual bool isOpened() {return false;}
 
     virtual void release() {}
@@ -28,6 +95,9 @@ public:
     virtual double get(int propId) {return 0;}
 
     // ~BaseCapture() = default;
+
+protected:
+    uint64_t frame_id_=0;
 };
 }
 #endif // BASE_CAPTURE_H
\ No newline at end of file
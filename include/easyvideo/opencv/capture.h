@@ -3,6 +3,7 @@
 
 #include "./jpegCapture.h"
 #include "./streamCapture.h"
+#include "./sharedCapture.h"
 #include "./yuyvCapture.h"
 // #include "easycpp/str.h"
 
@@ -19,6 +20,12 @@ public:
 
     bool read(cv::Mat &frame);
 
+    // grab as demuxTime, retrieve as decodeTime
+    bool read(Frame &frame);
+
+    // cv::VideoCapture reuses a continuous frame of matching size and type
+    bool readInto(cv::Mat &frame);
+
     bool isOpened();
 
     void release();
@@ -43,12 +50,20 @@ namespace Capture
         CAP_TYPE_NORMAL,
         CAP_TYPE_JPEG,
         CAP_TYPE_YUYV,
-        CAP_TYPE_STREAM
+        CAP_TYPE_STREAM,
+        CAP_TYPE_SHARED_STREAM  // SharedCapture, opt in
     };
 
+    /**
+     * props are passed to set() before the source is opened, e.g. {STREAM_DECODER_THREADS, 2}.
+     * rtsp/rtmp urls give a StreamCapture unless CAP_TYPE_SHARED_STREAM is asked for, which
+     * gives a SharedCapture: calls with the same url, decoder and props share one connection
+     * and decoder
+     */
     BaseCapture* createCapture(
         std::string url, int apiPreference=cv::CAP_ANY, 
-        int type=CAP_TYPE_NORMAL, bool dropFrame=false, std::string decoder="auto"
+        int type=CAP_TYPE_NORMAL, bool dropFrame=false, std::string decoder="auto",
+        std::vector<std::pair<int, double>> props={}
     );
 }
 }
@@ -31,8 +31,13 @@ public:
 
     double get(int propId);
 
+    // image shares the internal buffer, the next read overwrites it
     bool read(::cv::Mat& image);
 
+    bool read(Frame& frame);
+
+    bool readInto(::cv::Mat& image);
+
     void operator>>(::cv::Mat& image);
 
 private:
@@ -0,0 +1,67 @@
+#ifndef SHARED_CAPTURE_H
+#define SHARED_CAPTURE_H
+
+#include "./streamCapture.h"
+#include <vector>
+
+namespace easyvideo
+{
+/**
+ * consumer of a StreamCapture shared process wide. sources are keyed by url, decoder and the
+ * props set before open, the first consumer opens the source and the last release closes it,
+ * so connections and decoders scale with unique sources instead of consumers.
+ * each consumer reads through its own FrameSubscriber, frames are shared read only and the
+ * crop is a view into them. set() changes the shared source for every consumer.
+ * when the shared session stops, the next open() reopens it, the other consumers stay attached
+ */
+class SharedCapture: public BaseCapture
+{
+public:
+    SharedCapture() {};
+
+    /**
+     * decoder "auto" selects by codec id. dropFrame: newest frame only (SUBSCRIBE_LATEST),
+     * every frame otherwise (SUBSCRIBE_EVERY). a consumer more than 4 frames behind misses
+     * frames, decoding and the other consumers never wait for it
+     */
+    SharedCapture(std::string url, std::string decoder="auto",
+                  std::vector<std::pair<int, double>> props={}, bool dropFrame=false);
+
+    bool open(std::string url, std::string decoder,
+              std::vector<std::pair<int, double>> props={}, bool dropFrame=false);
+
+    // same decoder, props and policy as the last open
+    bool open(std::string url, int apiPreference=cv::CAP_ANY);
+
+    bool read(cv::Mat &frame);
+
+    bool read(Frame &frame);
+
+    bool isOpened();
+
+    void release();
+
+    void operator >> (cv::Mat &frame);
+
+    void set(int propId, double value);
+
+    // cv::CAP_PROP_FRAME_WIDTH/HEIGHT give the crop size when cropped
+    double get(int propId);
+
+    // clamped to each frame, empty for the whole frame
+    void setCrop(cv::Rect crop);
+
+    ~SharedCapture();
+
+    // sources open right now, and consumers of url over all its decoder settings
+    static size_t sources();
+
+    static int consumers(std::string url);
+
+private:
+    struct Impl;
+    Impl* impl_=nullptr;
+};
+}
+
+#endif // SHARED_CAPTURE_H
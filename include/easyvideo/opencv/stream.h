@@ -4,6 +4,53 @@
 #include <iostream>
 #include <stdio.h>
 #include <vector>
+#include <memory>
+#include <string>
+#include <functional>
+
+#include "../videoCodecType.h"
+#include "../utils/byteRing.h"
+
+/**
+ * a demuxed video packet, data stays valid as long as any copy of the handle
+ * is alive, so it can be queued between threads without copying the bytes
+ */
+struct StreamPacket
+{
+    uint8_t* data=nullptr;
+    int size=0;
+    int64_t pts=VIDEO_NOPTS_VALUE, dts=VIDEO_NOPTS_VALUE;
+    bool isKeyFrame=false;
+    double timeBase=0;      // seconds of one pts/dts unit
+    double recvTime=0;      // steady clock seconds when it was read, see steadySeconds() in baseCapture.h
+    double demuxTime=0;     // ms spent in read
+    std::shared_ptr<void> ref;
+};
+
+/**
+ * options of Stream::open, 0 or empty keeps the ffmpeg default.
+ * fastOpen reuses the codec parameters of the last successful open of the same url
+ * and skips avformat_find_stream_info, it falls back to probing when they do not match
+ */
+struct StreamOpenOptions
+{
+    std::string transport="udp";    // rtsp transport, "udp" or "tcp"
+    int64_t probesize=0;            // bytes
+    int64_t analyzeduration=0;      // microseconds
+    int fpsprobesize=-1;            // frames used to guess fps, -1 default
+    int64_t stimeout=2000000;       // socket timeout, microseconds
+    int64_t openTimeout=0;          // deadline of open and probing, microseconds, 0 for none
+    int64_t readTimeout=0;          // deadline of each read, microseconds, 0 for none
+    bool persistIndex=false;        // save the keyframe index of files as <file>.kfidx
+    bool fastOpen=false;
+};
+
+/**
+ * custom input of Stream: fill buf with up to size bytes and return the count. return 0
+ * or AVERROR_EOF at the end, AVERROR(EAGAIN) when nothing is available yet (Stream waits
+ * and calls again, honoring interrupt() and the deadlines), other AVERROR codes on errors
+ */
+using StreamReadCallback = std::function<int(uint8_t* buf, int size)>;
 
 class Stream
 {
@@ -19,6 +66,25 @@ public:
 
     int open(std::string url);
 
+    int open(std::string url, const StreamOpenOptions& options);
+
+    /**
+     * demux from application data instead of a url, format is the name of the ffmpeg
+     * demuxer, e.g. "h264", "hevc" or "mpegts", empty to probe it. the bytes are read
+     * straight into the avio buffer of the demuxer without another intermediate copy
+     */
+    int open(StreamReadCallback read, std::string format="", const StreamOpenOptions& options=StreamOpenOptions());
+
+    // the ring is filled by another thread, close() it at the end of the stream. reads block
+    // until data arrives, the ring is closed or interrupt() / a deadline ends them
+    int open(easyvideo::ByteRing& ring, std::string format="", const StreamOpenOptions& options=StreamOpenOptions());
+
+    // data must stay valid until close, seekable
+    int openMemory(const uint8_t* data, size_t size, std::string format="", const StreamOpenOptions& options=StreamOpenOptions());
+
+    // drop the cached codec parameters of url used by fastOpen, all urls if empty
+    static void clearStreamInfoCache(const std::string& url="");
+
     int width();
 
     int height();
@@ -27,17 +93,60 @@ public:
 
     int codec_id();
 
+    // seconds of one pts/dts unit
+    double timeBase();
+
     int cur_dts();
 
+    // data returned by the two functions below is only valid until the next read
     void* read(int& size);
 
     void* read(int& size, int64_t& pts, int64_t& dts, bool& isKeyFrame);
 
+    // 0 on success, negative AVERROR code otherwise, e.g. AVERROR_EOF,
+    // AVERROR(ETIMEDOUT) when StreamOpenOptions::readTimeout expired
+    int read(StreamPacket& packet);
+
+    // last read reached the end of file
+    bool eof();
+
+    /**
+     * file sources only. seek to the last keyframe at or before pts (stream time base),
+     * the next read returns that keyframe and frame is set to its frame number.
+     * the caller decodes forward to the exact position. the keyframe index is built
+     * by reading the file once on first use, or loaded from <file>.kfidx with persistIndex
+     */
+    int seek(int64_t pts, int64_t& frame);
+
+    // same for the keyframe at or before frame number n
+    int seekFrame(int64_t n, int64_t& frame);
+
+    // build or load the keyframe index now instead of on first seek
+    int buildIndex();
+
+    // the getters return values cached on open, safe to call while another thread
+    // reopens the stream
+
+    // pts of the first frame, 0 if unknown
+    int64_t startTime();
+
+    // number of video frames from the container or the keyframe index, -1 until
+    // one of them is known. does not build the index
+    int64_t frameCount();
+
+    // abort a blocking open or read from another thread, it returns AVERROR_EXIT.
+    // sticky, opens and reads keep failing until resume()
+    void interrupt();
+
+    // clear interrupt(), call it from the thread owning the stream before opening again
+    void resume();
+
     void close();
 
     void setStep(size_t step);
 
 private:
+    int openInput(std::string url, std::string format, const StreamOpenOptions& options);
 
     struct Impl;
     Impl* impl=nullptr;
@@ -2,17 +2,123 @@
 #define STREAMCAPTURE_H
 
 #include "./baseCapture.h"
+#include "../videoCodecType.h"
+#include "./stream.h"
+#include <functional>
+#include <memory>
 #define STREAM_RECV_METHOD -100
+// decode every step-th packet only, breaks inter-coded streams, use STREAM_DECODE_MODE instead
 #define STREAM_RECV_STEP -200
+// VIDEO_FRAME_BGR(default), VIDEO_FRAME_I420 or VIDEO_FRAME_NV12, see videoCodecType.h. output format,
+// letterbox and decode mode set while frames are read take effect from the next frame
+#define STREAM_OUTPUT_FORMAT -300
+// letterbox bgr output into (width, height) like static_resize, get ratio returns its value of the last frame
+#define STREAM_LETTERBOX_WIDTH -400
+#define STREAM_LETTERBOX_HEIGHT -500
+#define STREAM_LETTERBOX_RATIO -600
+// decoder threads, set before open: count (-1 default, 0 auto) and DecoderThreadType
+#define STREAM_DECODER_THREADS -700
+#define STREAM_DECODER_THREAD_TYPE -800
+// DecodeMode, DECODE_MODE_KEYFRAME drops non-key packets before decoding
+#define STREAM_DECODE_MODE -900
+// output at most this many frames per second chosen by pts, 0 for all. every frame is still
+// decoded, only the selected ones are converted
+#define STREAM_OUTPUT_FPS -1000
+// read packets on a dedicated demux thread into a bounded ring, set before open: 0 off(default), 1 on
+#define STREAM_DEMUX_THREAD -1100
+// ring capacity in packets (default 64) and StreamRingPolicy when it is full
+#define STREAM_RING_DEPTH -1200
+#define STREAM_RING_POLICY -1300
+// get only: packets currently queued in the ring, and packets dropped by STREAM_RING_DROP_GOP
+#define STREAM_RING_SIZE -1400
+#define STREAM_RING_DROPPED -1500
+// open options, see StreamOpenOptions in stream.h, set before open. transport: 0 udp(default), 1 tcp
+#define STREAM_RTSP_TRANSPORT -1600
+#define STREAM_PROBESIZE -1700
+#define STREAM_ANALYZEDURATION -1800
+#define STREAM_FPS_PROBESIZE -1900
+#define STREAM_TIMEOUT -2000
+// 1: skip stream probing on reopen of a known url with the cached codec parameters
+#define STREAM_FAST_OPEN -2100
+// deadlines in microseconds, 0 for none. a read past its deadline fails like a disconnection
+#define STREAM_OPEN_TIMEOUT -2200
+#define STREAM_READ_TIMEOUT -2300
+// reopen only the demuxer when reading fails, attempts per disconnection: 0 off(default), -1 unlimited.
+// the decoder is flushed and kept unless size or codec changed. get STREAM_RECONNECT_COUNT for the total
+#define STREAM_RECONNECT -2400
+// backoff in ms, starts at delay and doubles up to max delay, each wait is jittered down to half
+#define STREAM_RECONNECT_DELAY -2500
+#define STREAM_RECONNECT_MAX_DELAY -2600
+#define STREAM_RECONNECT_COUNT -2700
+// live sources: when the packet about to be decoded is more than this many ms behind the
+// newest one, packets are dropped up to the next keyframe in time, before decoding. 0 off(default).
+// lag is measured on the ring with STREAM_DEMUX_THREAD, against the wall clock otherwise
+#define STREAM_MAX_LAG -2800
+// get only: gops and frames dropped by STREAM_MAX_LAG, and the lag of the last packet in ms
+#define STREAM_LAG_SKIPPED_GOPS -2900
+#define STREAM_LAG_SKIPPED_FRAMES -3000
+#define STREAM_LAG -3100
+// get only: 1 once the receive thread of drop mode or subscribe() stopped, e.g. at end of stream
+#define STREAM_RECV_ENDED -3200
+// 1 to save the keyframe index of files as <file>.kfidx next to them, off by default
+#define STREAM_PERSIST_INDEX -3300
 
 namespace easyvideo
 {
 enum StreamRecvMethod
 {
     STREAM_RECV_METHOD_BLOCK,
+    // read() returns the newest frame, readers on several threads take turns and each frame goes to one of them
     STREAM_RECV_METHOD_DROP
 };
 
+enum StreamRingPolicy
+{
+    STREAM_RING_BLOCK,      // demux thread waits for room, the socket is not drained meanwhile
+    STREAM_RING_DROP_GOP    // the demux thread drops the incoming packets until the next keyframe, queued ones are kept
+};
+
+enum SubscribePolicy
+{
+    SUBSCRIBE_EVERY,    // every frame in order, new frames are dropped for it alone while queue_depth frames are unread
+    SUBSCRIBE_LATEST,   // newest frame only, an unread older one is replaced
+    SUBSCRIBE_NTH,      // every value-th frame, the oldest unread is dropped when the queue is full
+    SUBSCRIBE_MAX_FPS   // at most value frames per second chosen by pts, dropped like SUBSCRIBE_NTH
+};
+
+/**
+ * pull handle returned by StreamCapture::subscribe. the frames are shared by all subscribers
+ * and the capture without copying, treat them as read only and clone before writing.
+ * destroying the handle unsubscribes
+ */
+class FrameSubscriber
+{
+public:
+    struct Impl;
+
+    explicit FrameSubscriber(std::shared_ptr<Impl> impl): impl_(impl) {};
+
+    ~FrameSubscriber();
+
+    // next frame by the policy, timeout_ms < 0 waits forever. false on timeout, or when the stream ended and every frame was read
+    bool read(cv::Mat &frame, int timeout_ms=-1);
+
+    // with FrameInfo, info.dropped also counts the frames the policy or the queue dropped
+    bool read(Frame &frame, int timeout_ms=-1);
+
+    // frames queued and not read yet
+    size_t pending();
+
+    // frames delivered to the queue, and frames dropped unread: from the queue, or for
+    // SUBSCRIBE_EVERY the new ones a full queue had no room for
+    uint64_t received();
+
+    uint64_t dropped();
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
 struct streamData
 {
     void* data=nullptr;
@@ -35,11 +141,65 @@ public:
 
     bool read(cv::Mat &frame);
 
+    // pts, receive time and stage times of the frame, see FrameInfo
+    bool read(Frame &frame);
+
+    // decoded in place when blocking, frames of drop mode or subscribe() are shared and copied once
+    bool readInto(cv::Mat &frame);
+
     /**
      * read origin data without decoding
      */
     bool readStream(streamData& data);
 
+    /**
+     * read origin data without decoding, the packet can be kept after next read
+     */
+    bool readStream(StreamPacket& packet);
+
+    /**
+     * file sources only, frame exact: seeks to the keyframe before the target and decodes
+     * forward, the frames in between are not color converted. the keyframe index is built
+     * on first seek (one pass over the file), and saved as <file>.kfidx for the next open
+     * when STREAM_PERSIST_INDEX is set before open.
+     * set(cv::CAP_PROP_POS_MSEC / cv::CAP_PROP_POS_FRAMES) calls these
+     */
+    bool seek(double seconds);
+
+    bool seekFrame(int64_t n);
+
+    /**
+     * build the keyframe index now instead of on first seek. when the container has no
+     * frame count, get(cv::CAP_PROP_FRAME_COUNT) returns -1 until the index is built,
+     * it never scans the file itself
+     */
+    bool buildIndex();
+
+    /**
+     * called on the decoding thread before the first frame and when the decoded size
+     * changes mid stream, frames keep coming without reopening. get(cv::CAP_PROP_FRAME_WIDTH)
+     * and get(cv::CAP_PROP_FRAME_HEIGHT) report the decoded size once a frame is decoded.
+     * safe to call while frames are read, the decoding thread takes it before its next frame
+     */
+    void setFormatChangeCallback(std::function<void(int width, int height)> callback);
+
+    /**
+     * one demux and decode of this capture fanned out to any number of consumers, each with its
+     * own SubscribePolicy. value is n for SUBSCRIBE_NTH and the fps for SUBSCRIBE_MAX_FPS.
+     * a receive thread decodes once the capture is open, read() then returns the newest frame
+     * like STREAM_RECV_METHOD_DROP and seeking is not available. subscriptions end with release().
+     * no subscriber slows down decoding or the others, each only loses frames from its own queue.
+     * called while another thread is inside a blocking read(), it waits for that frame first
+     */
+    std::shared_ptr<FrameSubscriber> subscribe(int policy=SUBSCRIBE_LATEST, double value=0, int queue_depth=4);
+
+    /**
+     * release and open again, the subscriptions stay attached and get the frames of the new
+     * session, e.g. once STREAM_RECV_ENDED reports the old one stopped. props are set() before
+     * opening, decoder_name "auto" selects by codec id
+     */
+    bool reopen(std::string url, std::string decoder_name="auto", std::vector<std::pair<int, double>> props={});
+
     bool isOpened();
 
     void release();
@@ -23,8 +23,14 @@ public:
 
     double get(int propId);
 
+    // image shares the internal buffer, the next read overwrites it
     bool read(cv::Mat& image);
 
+    // info.dropped is step - 1
+    bool read(Frame& frame);
+
+    bool readInto(cv::Mat& image);
+
     void operator>>(cv::Mat& image);
 
 private:
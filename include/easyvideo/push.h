@@ -16,6 +16,8 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "./videoCodecType.h"
+
 extern "C"
 {
 #include <libavcodec/avcodec.h>
@@ -40,6 +42,8 @@ public:
     void push_frame(cv::Mat &frame);
     void pushFrameData(cv::Mat &frame);
     int open_codec(int width, int height, int den, int kB=100, std::string encoder_name="");
+    // VIDEO_FRAME_BGR(default), VIDEO_FRAME_I420 or VIDEO_FRAME_NV12, yuv frames are pushed without color conversion
+    void setInputFormat(int format);
     bool isConnected();
 
 private:
@@ -65,6 +69,7 @@ private:
     SwsContext* sws_ctx=nullptr;
 
     bool enable_hardware=false;
+    int input_format_=VIDEO_FRAME_BGR;
 };
 
 
@@ -0,0 +1,66 @@
+#ifndef STREAM_GROUP_H
+#define STREAM_GROUP_H
+
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include "./opencv/stream.h"
+#include "./videoCodecType.h"
+
+namespace easyvideo
+{
+/**
+ * many streams decoded by a fixed pool of worker threads instead of a decoding
+ * thread per camera. each stream has a light reader thread, it blocks in io and
+ * queues whole packets, the workers only decode streams with queued packets, one
+ * worker per stream at a time. a live stream whose queue is full drops packets up to
+ * the next keyframe. disconnected streams are reopened by their reader with backoff,
+ * a file ends at its last frame.
+ */
+class StreamGroup
+{
+public:
+    // called on a worker thread, frames of one stream come in order.
+    // every frame is a new buffer, it can be kept after the callback returns
+    using FrameCallback = std::function<void(int id, const cv::Mat& frame)>;
+
+    // threads <= 0: one per cpu core
+    explicit StreamGroup(int threads=0);
+
+    ~StreamGroup();
+
+    /**
+     * decoder_name "auto" selects by codec id, names ending with "_rkmpp" use rkmpp.
+     * returns the id passed to callback, streams are opened by their reader threads.
+     * unset readTimeout and openTimeout of options become 5 s
+     */
+    int add(std::string url, FrameCallback callback, std::string decoder_name="auto",
+            StreamOpenOptions options=StreamOpenOptions());
+
+    // stops the reader of id, a frame being decoded may still reach the callback
+    bool remove(int id);
+
+    // VIDEO_FRAME_BGR(default), VIDEO_FRAME_I420 or VIDEO_FRAME_NV12, for streams added after
+    void setOutputFormat(int format);
+
+    void start();
+
+    // files continue where they stopped after the next start(), live streams are reopened
+    void stop();
+
+    int threads();
+
+    size_t size();
+
+    // frames delivered to the callback of id, -1 if unknown
+    int64_t frames(int id);
+
+    // the file of id reached its end and all of its frames were delivered
+    bool finished(int id);
+
+private:
+    struct Impl;
+    Impl* impl_=nullptr;
+};
+}
+
+#endif // STREAM_GROUP_H
@@ -0,0 +1,155 @@
+#ifndef EASYVIDEO_BYTE_RING_H
+#define EASYVIDEO_BYTE_RING_H
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <stdint.h>
+#include <string.h>
+
+namespace easyvideo
+{
+/**
+ * bounded lock-free byte ring, one thread writes (e.g. socket reads of a custom
+ * transport) while one thread reads, e.g. a Stream opened on it.
+ * write()/close() are producer only, read()/waitData() are consumer only, wake() from
+ * anywhere. write and close only take the mutex while the reader waits
+ */
+class ByteRing
+{
+public:
+    explicit ByteRing(size_t capacity=1<<20)
+    {
+        capacity_ = capacity > 0 ? capacity : 1;
+        buffer_.resize(capacity_);
+    }
+
+    // copies as much as fits, returns the bytes written
+    size_t write(const uint8_t* data, size_t size)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t room = capacity_ - (tail - head_.load(std::memory_order_acquire));
+        size_t n = size < room ? size : room;
+        put(tail, data, n);
+        tail_.store(tail + n, std::memory_order_release);
+        if (n > 0)
+        {
+            notify();
+        }
+        return n;
+    }
+
+    // returns the bytes read, 0 if empty
+    size_t read(uint8_t* data, size_t size)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t avail = tail_.load(std::memory_order_acquire) - head;
+        size_t n = size < avail ? size : avail;
+        get(head, data, n);
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // no more data will be written, the reader gets the rest and then end of stream
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+        notify();
+    }
+
+    bool closed() const
+    {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // block until there is data, the ring is closed or stop() is true, timeout_ms < 0 waits
+    // forever. set the flag behind stop() before calling wake(), then no waiter misses it
+    template <typename Stop>
+    bool waitData(Stop stop, int timeout_ms=-1)
+    {
+        auto ready = [this]() {return size() > 0 || closed();};
+        if (ready())
+        {
+            return true;
+        }
+        waiters_++;
+        // pairs with the fence in notify(): either it sees the waiter, or the waiter sees the data
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto woken = [&]() {return ready() || stop();};
+            if (timeout_ms < 0)
+            {
+                cond_.wait(lock, woken);
+            }
+            else
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), woken);
+            }
+        }
+        waiters_--;
+        return ready();
+    }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_all();
+    }
+
+private:
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+    }
+
+    // n bytes at ring position pos, split in two where it wraps around
+    void put(size_t pos, const uint8_t* data, size_t n)
+    {
+        size_t offset = pos % capacity_;
+        size_t first = n < capacity_ - offset ? n : capacity_ - offset;
+        memcpy(buffer_.data() + offset, data, first);
+        memcpy(buffer_.data(), data + first, n - first);
+    }
+
+    void get(size_t pos, uint8_t* data, size_t n) const
+    {
+        size_t offset = pos % capacity_;
+        size_t first = n < capacity_ - offset ? n : capacity_ - offset;
+        memcpy(data, buffer_.data() + offset, first);
+        memcpy(data + first, buffer_.data(), n - first);
+    }
+
+    std::vector<uint8_t> buffer_;
+    size_t capacity_ = 1;
+    // read() and write() run on different threads, a byte-sized ring would otherwise share one line for both indices
+    char pad0_[64];
+    std::atomic<size_t> head_{0};   // written by consumer
+    char pad1_[64];
+    std::atomic<size_t> tail_{0};   // written by producer
+    char pad2_[64];
+    std::atomic<bool> closed_{false};
+    std::atomic<int> waiters_{0};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef EASYVIDEO_LAG_CLOCK_H
+#define EASYVIDEO_LAG_CLOCK_H
+
+#include <algorithm>
+
+namespace easyvideo
+{
+/**
+ * how far a live packet is behind the camera, from its pts and arrival time alone.
+ * the network delay of a fresh packet is unknown but constant, so the smallest
+ * arrival - pts seen so far counts as no lag. that baseline follows the stream:
+ * it creeps up by drift seconds per second so a camera clock running slow does not
+ * add up to a lag, and starts over when pts jumps back (camera restart, wrap) or
+ * the lag passes maxLag, which no real backlog reaches
+ */
+class LagClock
+{
+public:
+    explicit LagClock(double maxLag=60, double drift=0.01, double maxBackJump=1)
+        : maxLag_(maxLag), drift_(drift), maxBackJump_(maxBackJump) {}
+
+    void reset()
+    {
+        started_ = false;
+    }
+
+    // seconds, pts and now in seconds
+    double update(double pts, double now)
+    {
+        double offset = now - pts;
+        // packets come in decode order, b-frames move pts back by a few frames only
+        if (!started_ || pts < lastPts_ - maxBackJump_)
+        {
+            started_ = true;
+            base_ = offset;
+        }
+        else
+        {
+            base_ = std::min(base_ + drift_ * std::max(now - lastNow_, 0.), offset);
+        }
+        lastPts_ = pts;
+        lastNow_ = now;
+        double lag = offset - base_;
+        if (lag > maxLag_)
+        {
+            base_ = offset;
+            lag = 0;
+        }
+        return lag;
+    }
+
+private:
+    double maxLag_, drift_, maxBackJump_;
+    bool started_ = false;
+    double base_ = 0, lastPts_ = 0, lastNow_ = 0;
+};
+}
+
+#endif // EASYVIDEO_LAG_CLOCK_H
@@ -15,6 +15,15 @@ namespace camera {
         struct Device
         {
             std::string name, source, type, format;
+            std::string decoder_name="auto";
+            int decoder_threads=-1;                     // -1 default, 0 auto
+            std::string decoder_thread_type="auto";     // auto/frame/slice
+            double output_fps=0;                        // decimate stream by pts, 0 for all frames
+            std::string rtsp_transport="udp";           // udp/tcp
+            bool fast_open=false;                       // reuse probed stream info on reopen
+            int reconnect_times=0;                      // in-place reconnect attempts, -1 unlimited
+            int read_timeout=0;                         // ms, 0 for none
+            bool share_source=false;                    // share connection and decoder with same source
             int fps, width, height;
             cv::Rect crop;
             int reopen_times=-1;
@@ -147,6 +156,42 @@ namespace camera {
         info.device.fps = device["fps"].as<int>();
         info.device.width = device["width"].as<int>();
         info.device.height = device["height"].as<int>();
+        if (device["decoder_name"].IsDefined())
+        {
+            info.device.decoder_name = device["decoder_name"].as<std::string>();
+        }
+        if (device["decoder_threads"].IsDefined())
+        {
+            info.device.decoder_threads = device["decoder_threads"].as<int>();
+        }
+        if (device["decoder_thread_type"].IsDefined())
+        {
+            info.device.decoder_thread_type = device["decoder_thread_type"].as<std::string>();
+        }
+        if (device["output_fps"].IsDefined())
+        {
+            info.device.output_fps = device["output_fps"].as<double>();
+        }
+        if (device["rtsp_transport"].IsDefined())
+        {
+            info.device.rtsp_transport = device["rtsp_transport"].as<std::string>();
+        }
+        if (device["fast_open"].IsDefined())
+        {
+            info.device.fast_open = device["fast_open"].as<bool>();
+        }
+        if (device["reconnect_times"].IsDefined())
+        {
+            info.device.reconnect_times = device["reconnect_times"].as<int>();
+        }
+        if (device["read_timeout"].IsDefined())
+        {
+            info.device.read_timeout = device["read_timeout"].as<int>();
+        }
+        if (device["share_source"].IsDefined())
+        {
+            info.device.share_source = device["share_source"].as<bool>();
+        }
 
         // std::cout << "crop" << std::endl;
         auto crop = device["preprocess"]["crop"].as<std::vector<int>>();
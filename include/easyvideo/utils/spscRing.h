@@ -0,0 +1,158 @@
+#ifndef EASYVIDEO_SPSC_RING_H
+#define EASYVIDEO_SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <stddef.h>
+
+namespace easyvideo
+{
+/**
+ * bounded lock-free ring for exactly one producer thread and one consumer thread.
+ * push()/waitRoom() are producer only, pop()/front()/waitItem() are consumer only,
+ * size()/wake() from anywhere. push and pop only take the mutex while the other side waits
+ */
+template <typename T>
+class SPSCRing
+{
+public:
+    explicit SPSCRing(size_t capacity=64)
+    {
+        reset(capacity);
+    }
+
+    // not thread safe, call while neither side is running
+    void reset(size_t capacity)
+    {
+        capacity_ = capacity > 0 ? capacity : 1;
+        buffer_.clear();
+        buffer_.resize(capacity_);
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    // false when full, item is left untouched then
+    bool push(T& item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= capacity_)
+        {
+            return false;
+        }
+        buffer_[tail % capacity_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        notify();
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = std::move(buffer_[head % capacity_]);
+        buffer_[head % capacity_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        notify();
+        return true;
+    }
+
+    // oldest item or nullptr, valid until the next pop
+    T* front()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &buffer_[head % capacity_];
+    }
+
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // block until an item is queued or stop() is true, timeout_ms < 0 waits forever.
+    // set the flag behind stop() before calling wake(), then no waiter misses it
+    template <typename Stop>
+    bool waitItem(Stop stop, int timeout_ms=-1)
+    {
+        return waitFor([this]() {return size() > 0;}, stop, timeout_ms);
+    }
+
+    // block until there is room for push() or stop() is true, timeout_ms < 0 waits forever
+    template <typename Stop>
+    bool waitRoom(Stop stop, int timeout_ms=-1)
+    {
+        return waitFor([this]() {return size() < capacity_;}, stop, timeout_ms);
+    }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_all();
+    }
+
+private:
+    template <typename Ready, typename Stop>
+    bool waitFor(Ready ready, Stop stop, int timeout_ms)
+    {
+        if (ready())
+        {
+            return true;
+        }
+        waiters_++;
+        // pairs with the fence in notify(): either it sees the waiter, or the waiter sees the item
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto woken = [&]() {return ready() || stop();};
+            if (timeout_ms < 0)
+            {
+                cond_.wait(lock, woken);
+            }
+            else
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), woken);
+            }
+        }
+        waiters_--;
+        return ready();
+    }
+
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+    }
+
+    std::vector<T> buffer_;
+    size_t capacity_ = 1;
+    // head_ and tail_ bounce between the two threads on every packet, keep each on its own line
+    char pad0_[64];
+    std::atomic<size_t> head_{0};   // written by consumer
+    char pad1_[64];
+    std::atomic<size_t> tail_{0};   // written by producer
+    char pad2_[64];
+    std::atomic<int> waiters_{0};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef EASYVIDEO_TRIPLE_BUFFER_H
+#define EASYVIDEO_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace easyvideo
+{
+/**
+ * latest value slot for one writer thread and one reader thread. the writer fills back()
+ * and publishes it, the reader swaps the newest published buffer into front(), neither
+ * side waits for the other or copies. values the reader never fetched are overwritten.
+ * back()/publish()/close() are writer only, fetch()/front()/frontSeq()/wait() reader only
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() {}
+
+    // not thread safe, call while neither side is running
+    void reset()
+    {
+        for (auto& buffer: buffers_)
+        {
+            buffer = T();
+        }
+        front_ = 0;
+        back_ = 2;
+        state_.store(1, std::memory_order_relaxed);
+        seqs_[0] = seqs_[1] = seqs_[2] = 0;
+        published_.store(0, std::memory_order_relaxed);
+        closed_.store(false, std::memory_order_relaxed);
+    }
+
+    T& back()
+    {
+        return buffers_[back_];
+    }
+
+    // back() becomes the newest value, the writer goes on with a free buffer
+    void publish()
+    {
+        uint64_t seq = published_.load(std::memory_order_relaxed) + 1;
+        seqs_[back_] = seq;
+        back_ = state_.exchange(back_ | DIRTY, std::memory_order_acq_rel) & INDEX;
+        published_.store(seq);
+        notify();
+    }
+
+    // no more values, wait() returns false once the last one is fetched
+    void close()
+    {
+        closed_.store(true);
+        notify();
+    }
+
+    bool closed() const
+    {
+        return closed_.load();
+    }
+
+    // true when a newer value was swapped into front()
+    bool fetch()
+    {
+        if ((state_.load(std::memory_order_relaxed) & DIRTY) == 0)
+        {
+            return false;
+        }
+        front_ = state_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    T& front()
+    {
+        return buffers_[front_];
+    }
+
+    // sequence number of front(), 1 for the first published value, 0 before
+    uint64_t frontSeq() const
+    {
+        return seqs_[front_];
+    }
+
+    // values published so far
+    uint64_t published() const
+    {
+        return published_.load();
+    }
+
+    /**
+     * block until a value newer than seq is published, timeout_ms < 0 waits forever.
+     * false on timeout, or when closed and nothing newer is left. the writer only
+     * takes the mutex while someone waits
+     */
+    bool wait(uint64_t seq, int timeout_ms=-1)
+    {
+        if (published_.load() > seq)
+        {
+            return true;
+        }
+        waiters_++;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [this, seq]() {return published_.load() > seq || closed_.load();};
+            if (timeout_ms < 0)
+            {
+                cond_.wait(lock, ready);
+            }
+            else
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+            }
+        }
+        waiters_--;
+        return published_.load() > seq;
+    }
+
+private:
+    enum {INDEX = 3, DIRTY = 4};
+
+    void notify()
+    {
+        if (waiters_.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+    }
+
+    T buffers_[3];
+    uint64_t seqs_[3] = {0, 0, 0};
+    // the reader and writer each own one index, the shared state_ sits on a third line
+    char pad0_[64];
+    int front_ = 0;     // reader
+    char pad1_[64];
+    int back_ = 2;      // writer
+    char pad2_[64];
+    std::atomic<int> state_{1};     // index of the middle buffer | DIRTY when it is newer than front
+    std::atomic<uint64_t> published_{0};
+    char pad3_[64];
+    std::atomic<int> waiters_{0};
+    std::atomic<bool> closed_{false};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+}
+
+#endif
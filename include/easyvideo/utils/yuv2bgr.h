@@ -0,0 +1,70 @@
+#ifndef EASYVIDEO_YUV2BGR_H
+#define EASYVIDEO_YUV2BGR_H
+
+#include <stdint.h>
+
+namespace easyvideo
+{
+enum YUV2BGRKernel
+{
+    YUV2BGR_KERNEL_AUTO,
+    YUV2BGR_KERNEL_SCALAR,
+    YUV2BGR_KERNEL_SSE41,
+    YUV2BGR_KERNEL_AVX2,
+    YUV2BGR_KERNEL_NEON
+};
+
+/**
+ * fixed-point ITU-R BT.601 (limited range) YUV420 to BGR24, every kernel gives
+ * bit-exact the same result. strides are in bytes, so frame->data/linesize of an
+ * AVFrame can be passed directly.
+ */
+void YUV420P2BGR(const uint8_t* y, int y_stride,
+                 const uint8_t* u, int u_stride,
+                 const uint8_t* v, int v_stride,
+                 uint8_t* bgr, int bgr_stride, int width, int height);
+
+void NV12_2_BGR(const uint8_t* y, int y_stride,
+                const uint8_t* uv, int uv_stride,
+                uint8_t* bgr, int bgr_stride, int width, int height);
+
+/**
+ * scale + convert + pad in one pass: the yuv420 image is bilinear scaled into the
+ * top-left of a (dst_width, dst_height) BGR24 canvas keeping its aspect ratio, the
+ * rest is filled with 114. same layout as static_resize in resize.h, and also
+ * returns 1 / ratio like it.
+ */
+float letterboxYUV420P2BGR(const uint8_t* y, int y_stride,
+                           const uint8_t* u, int u_stride,
+                           const uint8_t* v, int v_stride,
+                           int src_width, int src_height,
+                           uint8_t* bgr, int bgr_stride, int dst_width, int dst_height);
+
+float letterboxNV12_2_BGR(const uint8_t* y, int y_stride,
+                          const uint8_t* uv, int uv_stride,
+                          int src_width, int src_height,
+                          uint8_t* bgr, int bgr_stride, int dst_width, int dst_height);
+
+/**
+ * copy a packed (height * 3 / 2, width) I420 or NV12 image into separate y/u/v
+ * planes with their own strides, e.g. the planes of an AV_PIX_FMT_YUV420P AVFrame
+ */
+void splitYUV420(const uint8_t* src, int width, int height, bool nv12,
+                 uint8_t* y, int y_stride,
+                 uint8_t* u, int u_stride,
+                 uint8_t* v, int v_stride);
+
+/**
+ * the best kernel supported by current cpu is selected on first use,
+ * set YUV2BGR_KERNEL_AUTO to select it again. return false if not supported.
+ */
+bool setYUV2BGRKernel(int kernel);
+
+bool isYUV2BGRKernelSupported(int kernel);
+
+int getYUV2BGRKernel();
+
+const char* getYUV2BGRKernelName(int kernel);
+}
+
+#endif
@@ -1,6 +1,11 @@
 #ifndef VIDEO_CODEC_TYPE_H
 #define VIDEO_CODEC_TYPE_H
 
+#include <stdint.h>
+
+// same as AV_NOPTS_VALUE
+#define VIDEO_NOPTS_VALUE ((int64_t)UINT64_C(0x8000000000000000))
+
 enum CODEC {
     CODEC_AUTO,
     CODEC_H264 = 27,
@@ -8,6 +13,43 @@ enum CODEC {
 };
 
 
+// layout of cv::Mat passed between decoder and encoder, yuv formats are
+// single channel (height * 3 / 2, width) images as cv::COLOR_YUV2BGR_I420/NV12 expect
+enum VideoFrameFormat
+{
+    VIDEO_FRAME_BGR,
+    VIDEO_FRAME_I420,
+    VIDEO_FRAME_NV12
+};
+
+
+// threading of software decoders, AUTO lets libavcodec choose (frame and slice)
+enum DecoderThreadType
+{
+    DECODER_THREAD_AUTO,
+    DECODER_THREAD_FRAME,   // throughput, adds (thread count - 1) frames of latency
+    DECODER_THREAD_SLICE    // low latency, only helps streams encoded with several slices
+};
+
+
+// which frames are decoded, skipped frames never produce an output
+enum DecodeMode
+{
+    DECODE_MODE_ALL,
+    DECODE_MODE_KEYFRAME,   // only keyframes, e.g. one frame per GOP for thumbnails
+    DECODE_MODE_NONREF      // skip non-reference frames, the rest still decodes correctly
+};
+
+
+// return values of VideoDecoder::sendPacket / receiveFrame, errors are negative
+enum DecodeStatus
+{
+    DECODE_OK,
+    DECODE_AGAIN,   // receiveFrame: send more packets first, sendPacket: receive frames first
+    DECODE_EOF      // all frames are received after draining, call flush() to decode again
+};
+
+
 enum CodecPlatform
 {
     CODEC_PLATFORM_FFMPEG,
@@ -7,6 +7,8 @@
 #include <queue>
 #include <condition_variable>
 #include <thread>
+#include <functional>
+#include <errno.h>
 #include <opencv2/opencv.hpp>
 
 #include "./videoCodecType.h"
@@ -14,14 +16,146 @@
 class VideoDecoder {
 public:
     VideoDecoder() {}; 
+    virtual ~VideoDecoder() {};
     virtual int open_codec(int width, int height, int fps, int decode_id=CODEC_H264){printf("not complete!"); return 1;};
     virtual int open_codec(int width, int height, int fps, std::string decoder_name=""){printf("not complete!"); return 1;};
+    // 0 with a frame, -EAGAIN (AVERROR(EAGAIN)) when the packet was taken without giving one yet, < 0 on errors
     virtual int decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll=false){printf("not complete!"); return 1;};
+
+    /**
+     * decoupled decode, one packet may give zero or more frames which are kept in a
+     * small queue until receiveFrame. sendPacket(nullptr, 0) drains at end of stream.
+     * pts/dts are in the time base of the stream, they come back with peekFrame.
+     * the defaults below wrap decodeFrame, at most one frame per packet.
+     * sendPacket returns < 0 on decode errors
+     */
+    virtual int sendPacket(uint8_t *inData, int inLen, int64_t pts=VIDEO_NOPTS_VALUE, int64_t dts=VIDEO_NOPTS_VALUE)
+    {
+        if (inData == nullptr || inLen <= 0)
+        {
+            pending_ret_ = DECODE_EOF;
+            return DECODE_OK;
+        }
+        int ret = decodeFrame(inData, inLen, pending_frame_);
+        if (ret != 0 && ret != -EAGAIN)
+        {
+            pending_ret_ = DECODE_AGAIN;
+            return ret < 0 ? ret : -1;
+        }
+        pending_ret_ = ret == 0 ? DECODE_OK : DECODE_AGAIN;
+        pending_pts_ = pts;
+        return DECODE_OK;
+    };
+    virtual int receiveFrame(cv::Mat &outMatV)
+    {
+        int ret = pending_ret_;
+        if (ret == DECODE_OK)
+        {
+            cv::swap(pending_frame_, outMatV);
+            pending_ret_ = DECODE_AGAIN;
+        }
+        return ret;
+    };
+    /**
+     * pts of the frame the next receiveFrame returns, without converting it.
+     * together with skipFrame, frames that are not wanted are never converted
+     */
+    virtual int peekFrame(int64_t &pts)
+    {
+        pts = pending_pts_;
+        return pending_ret_;
+    };
+    virtual int skipFrame()
+    {
+        int ret = pending_ret_;
+        if (ret == DECODE_OK)
+        {
+            pending_ret_ = DECODE_AGAIN;
+        }
+        return ret;
+    };
+    // drop queued frames and reset decoding state, e.g. after draining or seeking
+    virtual int flush() {pending_ret_ = DECODE_AGAIN; return 0;};
+
+    /**
+     * VIDEO_FRAME_BGR(default), VIDEO_FRAME_I420 or VIDEO_FRAME_NV12,
+     * yuv formats copy decoded planes without color conversion
+     */
+    void setOutputFormat(int format) {output_format_=format;};
+
+    /**
+     * letterbox BGR output into size while converting from yuv, (0, 0) to disable.
+     * same layout as static_resize in utils/resize.h, whose return value is kept in letterbox_ratio_
+     */
+    void setLetterbox(cv::Size size) {letterbox_size_=size;};
+    float getLetterboxRatio() {return letterbox_ratio_;};
+
+    /**
+     * set before open_codec. count: -1 libavcodec default (1 thread), 0 one per cpu core,
+     * type: DecoderThreadType. hardware decoders ignore it
+     */
+    void setThreads(int count, int type=DECODER_THREAD_AUTO) {thread_count_=count; thread_type_=type;};
+
+    /**
+     * DecodeMode, can be changed while decoding. with DECODE_MODE_KEYFRAME the caller
+     * should also drop non-key packets, they are decoded for nothing otherwise
+     */
+    void setDecodeMode(int mode) {decode_mode_=mode;};
+
+    /**
+     * raw elementary stream input, e.g. annex-b .h264/.hevc file blocks or socket reads.
+     * sendPacket then takes chunks of any size and splits them into access units itself,
+     * DECODE_AGAIN means the chunk was not taken, receive frames and send it again.
+     * flush() drops buffered input. rkmpp always splits (MPP_DEC_SET_PARSER_SPLIT_MODE)
+     */
+    void setStreamMode(bool enable) {stream_mode_=enable;};
+
+    /**
+     * called on the decoding thread before the first frame and whenever the decoded size
+     * changes mid stream, e.g. a camera reconfigured from its web page sends a new SPS.
+     * output buffers follow the frame size by themselves, this is for consumers keeping
+     * per-size state (encoders, roi, letterbox targets). width_/height_ are updated before
+     */
+    using FormatChangeCallback = std::function<void(int width, int height)>;
+    void setFormatChangeCallback(FormatChangeCallback callback) {format_change_cb_=callback;};
+
+    // size of the last decoded frame, false when unchanged
+    bool updateFrameSize(int width, int height)
+    {
+        if (width == frame_width_ && height == frame_height_)
+        {
+            return false;
+        }
+        frame_width_ = width;
+        frame_height_ = height;
+        width_ = width;
+        height_ = height;
+        if (format_change_cb_)
+        {
+            format_change_cb_(width, height);
+        }
+        return true;
+    };
     
     int decode_id_=CODEC_H264;
     int width_;
     int height_;
     int fps_;
+    int output_format_=VIDEO_FRAME_BGR;
+    cv::Size letterbox_size_=cv::Size(0, 0);
+    float letterbox_ratio_=1.;
+
+    int thread_count_=-1;
+    int thread_type_=DECODER_THREAD_AUTO;
+    int decode_mode_=DECODE_MODE_ALL;
+    bool stream_mode_=false;
+    int frame_width_=-1;
+    int frame_height_=-1;
+    FormatChangeCallback format_change_cb_;
+
+    cv::Mat pending_frame_;
+    int pending_ret_=DECODE_AGAIN;
+    int64_t pending_pts_=VIDEO_NOPTS_VALUE;
 
 };
 
@@ -20,6 +20,12 @@ public:
     int open_codec(int width, int height, int fps, int kB=100, int encode_id=CODEC_H264, int num_threads=4, int gop=30);
     int open_codec(int width, int height, int fps, int kB=100, std::string encoder_name="libx264", int num_threads=4, int gop=30);
 
+    /**
+     * VIDEO_FRAME_BGR(default), VIDEO_FRAME_I420 or VIDEO_FRAME_NV12,
+     * yuv frames, e.g. from VideoDecoder::setOutputFormat, are encoded without color conversion
+     */
+    void setInputFormat(int format);
+
     int encodeFrame(cv::Mat &frame, uint8_t *outData, int &outLen);
 
     int encodeFrame(cv::Mat &frame, void* packet);
@@ -31,6 +37,7 @@ public:
     int width_=0;
     int height_=0;
     int fps_=0;
+    int input_format_=VIDEO_FRAME_BGR;
 
 private:
     int kB_=100;
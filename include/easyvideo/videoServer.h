@@ -37,6 +37,11 @@ namespace easyvideo
                 {info.crop.x, info.crop.y, info.crop.width, info.crop.height},
                 info.decoder_name
             );
+            setDecoderThreads(info.decoder_threads, info.decoder_thread_type);
+            setOutputFps(info.output_fps);
+            setOpenOptions(info.rtsp_transport, info.fast_open);
+            setReconnect(info.reconnect_times, info.read_timeout);
+            setShareSource(info.share_source);
         }
 
         void setupSource(YAML::Node config)
@@ -59,6 +64,110 @@ namespace easyvideo
                 config["preprocess"]["crop"].as<std::vector<int>>(),
                 decoder_name
             );
+
+            int decoder_threads = -1;
+            std::string decoder_thread_type = "auto";
+            if (config["decoder_threads"].IsDefined())
+            {
+                decoder_threads = config["decoder_threads"].as<int>();
+            }
+            if (config["decoder_thread_type"].IsDefined())
+            {
+                decoder_thread_type = config["decoder_thread_type"].as<std::string>();
+            }
+            setDecoderThreads(decoder_threads, decoder_thread_type);
+
+            if (config["output_fps"].IsDefined())
+            {
+                setOutputFps(config["output_fps"].as<double>());
+            }
+
+            std::string rtsp_transport = "udp";
+            bool fast_open = false;
+            if (config["rtsp_transport"].IsDefined())
+            {
+                rtsp_transport = config["rtsp_transport"].as<std::string>();
+            }
+            if (config["fast_open"].IsDefined())
+            {
+                fast_open = config["fast_open"].as<bool>();
+            }
+            setOpenOptions(rtsp_transport, fast_open);
+
+            int reconnect_times = 0, read_timeout = 0;
+            if (config["reconnect_times"].IsDefined())
+            {
+                reconnect_times = config["reconnect_times"].as<int>();
+            }
+            if (config["read_timeout"].IsDefined())
+            {
+                read_timeout = config["read_timeout"].as<int>();
+            }
+            setReconnect(reconnect_times, read_timeout);
+
+            if (config["share_source"].IsDefined())
+            {
+                setShareSource(config["share_source"].as<bool>());
+            }
+        }
+
+        /**
+         * streams only, off by default. servers of the same url, decoder and settings in this
+         * process read one SharedCapture, a roi is a view of the shared frame instead of a copy.
+         * applied on next openSource()
+         */
+        void setShareSource(bool share)
+        {
+            share_source_ = share;
+        }
+
+        /**
+         * frames per second passed to callback for streams, chosen by pts before color
+         * conversion, 0 for all frames. applied on next openSource()
+         */
+        void setOutputFps(double fps)
+        {
+            output_fps_ = fps;
+        }
+
+        /**
+         * rtsp transport "udp" or "tcp", fast_open skips stream probing when the source
+         * is reopened, e.g. after a disconnection. applied on next openSource()
+         */
+        void setOpenOptions(std::string transport, bool fast_open=false)
+        {
+            rtsp_transport_ = "tcp" == transport ? 1 : 0;
+            fast_open_ = fast_open;
+        }
+
+        /**
+         * streams reconnect in place up to times attempts (-1 unlimited) keeping the decoder,
+         * before the whole capture is reopened. read_timeout(ms, 0 for none) makes a stalled
+         * connection count as lost. the backoff starts at reopen_delay. both default to 0, a lost
+         * stream reopens the whole capture as before. applied on next openSource()
+         */
+        void setReconnect(int times, int read_timeout=0)
+        {
+            reconnect_times_ = times;
+            read_timeout_ = read_timeout;
+        }
+
+        /**
+         * threads of software stream decoder, applied on next openSource()
+         * count: -1 default, 0 auto, type: "auto", "frame" or "slice"
+         */
+        void setDecoderThreads(int count, std::string type="auto")
+        {
+            decoder_threads_ = count;
+            decoder_thread_type_ = DECODER_THREAD_AUTO;
+            if ("frame" == type)
+            {
+                decoder_thread_type_ = DECODER_THREAD_FRAME;
+            }
+            else if ("slice" == type)
+            {
+                decoder_thread_type_ = DECODER_THREAD_SLICE;
+            }
         }
 
         void setupSource(
@@ -120,7 +229,25 @@ namespace easyvideo
         bool openSource()
         {
             clear();
-            cap_ = Capture::createCapture(source_, apiPreference_, type_, false, decoder_name_);
+            std::vector<std::pair<int, double>> props = {
+                {STREAM_DECODER_THREADS, decoder_threads_},
+                {STREAM_DECODER_THREAD_TYPE, decoder_thread_type_},
+                {STREAM_OUTPUT_FPS, output_fps_},
+                {STREAM_RTSP_TRANSPORT, rtsp_transport_},
+                {STREAM_FAST_OPEN, fast_open_ ? 1 : 0},
+                {STREAM_READ_TIMEOUT, read_timeout_ * 1000.},
+                {STREAM_RECONNECT, reconnect_times_},
+                {STREAM_RECONNECT_DELAY, reopen_delay_ > 0 ? reopen_delay_ : 100}
+            };
+            int type = share_source_ && type_ == Capture::CAP_TYPE_STREAM ? Capture::CAP_TYPE_SHARED_STREAM : type_;
+            cap_ = Capture::createCapture(source_, apiPreference_, type, false, decoder_name_, props);
+            // servers on the same camera share it, the crop becomes a view of the shared frame
+            auto shared = dynamic_cast<SharedCapture*>(cap_);
+            crop_view_ = crop_ && shared != nullptr;
+            if (crop_view_)
+            {
+                shared->setCrop(roi_);
+            }
             if (cap_->isOpened())
             {
                 // setup width and height
@@ -209,9 +336,19 @@ namespace easyvideo
                 if (cap_->read(frame))
                 {
                     // cv::imshow("ori", frame);
-                    if (crop_)
+                    if (crop_ && !crop_view_)
                     {
-                        frame(roi_).copyTo(frame);
+                        // the source may change its resolution while running
+                        cv::Rect roi = roi_ & cv::Rect(0, 0, frame.cols, frame.rows);
+                        if (roi != roi_ && frame.size() != last_size_)
+                        {
+                            std::cerr << name_ << ": roi " << roi_ << " clamped to frame " << frame.size() << std::endl;
+                        }
+                        last_size_ = frame.size();
+                        if (roi.area() > 0)
+                        {
+                            frame(roi).copyTo(frame);
+                        }
                     }
                     // std::cout << frame.size() << std::endl;
                     if (callback_set_)
@@ -244,11 +381,21 @@ namespace easyvideo
         std::string name_="unknown";
         std::string source_;
         std::string decoder_name_="auto";
+        int decoder_threads_=-1;
+        int decoder_thread_type_=DECODER_THREAD_AUTO;
+        double output_fps_=0;
+        int rtsp_transport_=0;
+        bool fast_open_=false;
+        int reconnect_times_=0;
+        int read_timeout_=0;
         cv::Rect roi_;
+        cv::Size last_size_;
         cv::Size size_;
         int reopen_times_=-1;
         int reopen_delay_=-1;
         bool crop_=false;
+        bool crop_view_=false;
+        bool share_source_=false;
         int fps_ = -1;
 
         bool callback_set_ = false;
@@ -12,6 +12,7 @@ easyvideo::NormalCapture::NormalCapture(std::string url, int apiPreference)
 
 bool easyvideo::NormalCapture::open(std::string url, int apiPreference)
 {
+    frame_id_ = 0;
     return cap.open(url, apiPreference);
 }
 
@@ -20,6 +21,37 @@ bool easyvideo::NormalCapture::read(cv::Mat &frame)
     return cap.read(frame);
 }
 
+bool easyvideo::NormalCapture::readInto(cv::Mat &frame)
+{
+    if (!frame.isContinuous())
+    {
+        frame.release();
+    }
+    return cap.read(frame);
+}
+
+bool easyvideo::NormalCapture::read(Frame &frame)
+{
+    double t0 = steadySeconds();
+    if (!cap.grab())
+    {
+        return false;
+    }
+    double t1 = steadySeconds();
+    if (!cap.retrieve(frame.image))
+    {
+        return false;
+    }
+    double msec = cap.get(cv::CAP_PROP_POS_MSEC);
+    frame.info = FrameInfo();
+    frame.info.pts = msec > 0 ? msec / 1000. : -1;
+    frame.info.recvTime = t1;
+    frame.info.demuxTime = (t1 - t0) * 1000.;
+    frame.info.decodeTime = (steadySeconds() - t1) * 1000.;
+    frame.info.id = ++frame_id_;
+    return true;
+}
+
 bool easyvideo::NormalCapture::isOpened()
 {
     return cap.isOpened();
@@ -72,10 +104,11 @@ bool checkIsStream(std::string source)
 easyvideo::BaseCapture* easyvideo::Capture::createCapture(
     std::string url, int apiPreference, 
     int type, bool dropFrame, 
-    std::string decoder
+    std::string decoder,
+    std::vector<std::pair<int, double>> props
 )
 {
-    if (checkIsStream(url))
+    if (checkIsStream(url) && type != CAP_TYPE_SHARED_STREAM)
     {
         type = CAP_TYPE_STREAM;
     }
@@ -90,11 +123,18 @@ easyvideo::BaseCapture* easyvideo::Capture::createCapture(
         case CAP_TYPE_YUYV:
             std::cout << "YUYV2BGRCapture" << std::endl;
             return new YUYV2BGRCapture(url, apiPreference);
+        case CAP_TYPE_SHARED_STREAM:
+            std::cout << "SharedCapture" << std::endl;
+            return new SharedCapture(url, decoder, props, dropFrame);
         case CAP_TYPE_STREAM:
         {
             std::cout << "StreamCapture" << std::endl;
             auto streamCapture = new StreamCapture();
             streamCapture->set(STREAM_RECV_METHOD, dropFrame?STREAM_RECV_METHOD_DROP:STREAM_RECV_METHOD_BLOCK);
+            for (auto& prop: props)
+            {
+                streamCapture->set(prop.first, prop.second);
+            }
             if (decoder == "auto")
             {
                 streamCapture->open(url, apiPreference);
@@ -148,6 +148,7 @@ easyvideo::MJPG2BGRCapture::MJPG2BGRCapture(std::string source, int apiPreferenc
 bool easyvideo::MJPG2BGRCapture::open(std::string source, int apiPreference)
 {
     bool success = cap.open(source, apiPreference);
+    frame_id_ = 0;
     if(success)
     {  
         sz.height = cap.get(::cv::CAP_PROP_FRAME_HEIGHT);
@@ -191,9 +192,19 @@ double easyvideo::MJPG2BGRCapture::get(int propId)
 
 bool easyvideo::MJPG2BGRCapture::read(::cv::Mat& image)
 {
+    Frame frame;
+    bool success = read(frame);
+    if (success) image = frame.image;
+    return success;
+}
+
+bool easyvideo::MJPG2BGRCapture::read(Frame& frame)
+{
+    double t0 = steadySeconds();
     bool success = cap.read(recvImage);
     if (success)
     {
+        double t1 = steadySeconds();
         if (first)
         {
             outImage = cv::Mat(sz, CV_8UC3);
@@ -203,12 +214,30 @@ bool easyvideo::MJPG2BGRCapture::read(::cv::Mat& image)
         for (;&recvImage.data[datasize] != &recvImage.dataend[0];datasize++);
         if (datasize != last_size) jpg2rgb(recvImage.data, outImage.data, datasize);
         // else std::cout << "skip" << std::endl;
-        image = outImage;
+        frame.image = outImage;
         last_size = datasize;
+
+        // jpg2rgb writes bgr, there is no separate conversion
+        frame.info = FrameInfo();
+        frame.info.recvTime = t1;
+        frame.info.demuxTime = (t1 - t0) * 1000.;
+        frame.info.decodeTime = (steadySeconds() - t1) * 1000.;
+        frame.info.id = ++frame_id_;
     }
     return success;
 }
 
+bool easyvideo::MJPG2BGRCapture::readInto(::cv::Mat& image)
+{
+    if (!cap.read(recvImage)) return false;
+    // jpg2rgb writes packed rows
+    if (!image.isContinuous()) image.release();
+    image.create(sz, CV_8UC3);
+    size_t datasize = recvImage.dataend - recvImage.data;
+    jpg2rgb(recvImage.data, image.data, datasize);
+    return true;
+}
+
 
 void easyvideo::MJPG2BGRCapture::operator>>(::cv::Mat& image)
 {
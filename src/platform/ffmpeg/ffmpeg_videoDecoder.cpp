@@ -2,6 +2,7 @@
 #define VIDEO_FFMPEGDECODER_CPP
 
 #include "easyvideo/videoDecoder.h"
+#include "easyvideo/utils/yuv2bgr.h"
 
 extern "C"
 {
@@ -17,7 +18,13 @@ extern "C"
 #include <libavutil/frame.h>
 }
 
-static enum AVPixelFormat hw_pix_fmt;
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <map>
+
+// max decoded frames kept between sendPacket and receiveFrame
+#define FFMPEG_DECODER_QUEUE_SIZE 8
 
 enum HW_TYPE
 {
@@ -27,21 +34,29 @@ enum HW_TYPE
     HW_TYPE_OTHER
 };
 
-static AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts)
-{
-    const enum AVPixelFormat *p;
+// one hw device context per device type, shared by every decoder of the process. codec lookup
+// and avcodec_open2 are thread safe (libavcodec locks codecs whose init is not by itself),
+// only creating a device is serialized, so decoders open in parallel
+static std::mutex hw_device_mutex;
+static std::map<int, AVBufferRef*> hw_devices;
 
-    for (p = pix_fmts; *p != -1; p++) 
+static int sharedHWDevice(AVHWDeviceType type, AVBufferRef **device)
+{
+    std::lock_guard<std::mutex> lock(hw_device_mutex);
+    AVBufferRef *&shared = hw_devices[type];
+    if (shared == nullptr)
     {
-        if (*p == hw_pix_fmt)
-        return *p;
+        int err = av_hwdevice_ctx_create(&shared, type, NULL, NULL, 0);
+        if (err < 0)
+        {
+            hw_devices.erase(type);
+            return err;
+        }
     }
-
-    fprintf(stderr, "Failed to get HW surface format.\n");
-    return AV_PIX_FMT_NONE;
+    *device = av_buffer_ref(shared);
+    return *device == nullptr ? AVERROR(ENOMEM) : 0;
 }
 
-
 // ---------------------------------------------------------------------------------------
 
 class FFMPEGVideoDecoder: public VideoDecoder 
@@ -49,10 +64,21 @@ class FFMPEGVideoDecoder: public VideoDecoder
 public:
     FFMPEGVideoDecoder() {}
 
+    ~FFMPEGVideoDecoder();
+
     virtual int open_codec(int width, int height, int fps, int decode_id=CODEC_H264);
     virtual int open_codec(int width, int height, int fps, std::string decoder_name="");
     virtual int decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll=false);
+    virtual int sendPacket(uint8_t *inData, int inLen, int64_t pts=VIDEO_NOPTS_VALUE, int64_t dts=VIDEO_NOPTS_VALUE);
+    virtual int receiveFrame(cv::Mat &outMatV);
+    virtual int peekFrame(int64_t &pts);
+    virtual int skipFrame();
+    virtual int flush();
 private:
+    int convertFrame(AVFrame *frame, cv::Mat &outMatV);
+
+    int sendStream(uint8_t *inData, int inLen, int64_t pts, int64_t dts);
+
 
     struct Impl;
     Impl *impl_=nullptr;
@@ -61,11 +87,81 @@ private:
 
 struct FFMPEGVideoDecoder::Impl
 {
-    cv::Mat AVFrameToCVMat(AVFrame *inFrameV);
+    int AVFrameToCVMat(AVFrame *inFrameV, cv::Mat &outMat);
+
+    int AVFrameToYUVMat(AVFrame *inFrameV, cv::Mat &outMat, int format);
+
+    int AVFrameToLetterboxMat(AVFrame *inFrameV, cv::Mat &outMat, cv::Size size, float &ratio);
+
+    int frameToMat(AVFrame *inFrameV, cv::Mat &outMat, int format, cv::Size letterbox, float &ratio);
+
+    AVFrame *toSupportedFormat(AVFrame *frame);
 
     int hw_decoder_init(AVCodecContext *ctx, const enum AVHWDeviceType type);
 
+    // get_format callback, reads hw_pix_fmt of the Impl set as ctx->opaque
+    static AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts);
+
+    int allocBuffers();
+
+    void setThreads(int count, int type);
+
+    AVBufferRef *getPacketBuffer(int size);
+
+    int fillPacket(AVPacket *pack, const uint8_t *data, int size, int64_t pts, int64_t dts);
+
+    void dropPacket(AVPacket *pack);
+
+    int initParser();
+
+    int sendParsed();
+
+    int parseStream(const uint8_t *data, int size, bool flushing, int &used);
+
+    int feedStream(bool flushing);
+
+    bool streamPending();
+
+    void resetStream();
+
+    int transferHWFrame(AVFrame *hwFrame);
+
+    AVFrame *getFrame();
+
+    void recycleFrame(AVFrame *frame);
+
+    int pullFrames();
+
+    void clearQueue();
+
+    void release();
+
     AVBufferRef *hw_device_ctx = NULL;
+    AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
+
+    // reused between frames, this class allocates nothing per packet or frame once the stream
+    // is running. avcodec_send_packet still allocates an AVBufferRef to hold each packet, and
+    // decoded frames get small refs to the decoder's pooled planes, both inside ffmpeg
+    AVPacket *packet=nullptr;
+    AVFrame *sw_frame=nullptr;
+    // formats the converters do not read, scaled to yuv420p
+    SwsContext *sws_ctx=nullptr;
+    AVFrame *conv_frame=nullptr;
+    std::deque<AVFrame*> frame_queue;   // decoded, waiting for receiveFrame
+    std::vector<AVFrame*> frame_pool;   // unused
+    bool draining=false;
+    bool eof=false;
+    // padded packet data, a buffer is free again once the decoder dropped its reference.
+    // packets point to them without holding a reference of their own
+    std::vector<AVBufferRef*> packet_bufs;
+
+    // stream mode, input chunks are cut into access units by the parser
+    AVCodecParserContext *parser=nullptr;
+    AVPacket *parsed=nullptr;           // cut but not taken by the codec yet
+    std::vector<uint8_t> stream_rest;   // not parsed yet because the codec was full
+    size_t stream_pos=0;
+    int64_t stream_pts=AV_NOPTS_VALUE;
+    int64_t stream_dts=AV_NOPTS_VALUE;
     
     AVCodecContext *codec_ctx_=nullptr;
     bool enable_hwaccel_=false;
@@ -74,12 +170,26 @@ struct FFMPEGVideoDecoder::Impl
 };
 
 
+AVPixelFormat FFMPEGVideoDecoder::Impl::get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts)
+{
+    const enum AVPixelFormat *p;
+    Impl *impl = (Impl *)ctx->opaque;
+
+    for (p = pix_fmts; *p != -1; p++) 
+    {
+        if (impl != nullptr && *p == impl->hw_pix_fmt)
+        return *p;
+    }
+
+    fprintf(stderr, "Failed to get HW surface format.\n");
+    return AV_PIX_FMT_NONE;
+}
+
 int FFMPEGVideoDecoder::Impl::hw_decoder_init(AVCodecContext *ctx, const enum AVHWDeviceType type)
 {
     int err = 0;
 
-    if ((err = av_hwdevice_ctx_create(&hw_device_ctx, type,
-                                    NULL, NULL, 0)) < 0) {
+    if ((err = sharedHWDevice(type, &hw_device_ctx)) < 0) {
         fprintf(stderr, "Failed to create specified HW device.\n");
         return err;
     }
@@ -88,185 +198,789 @@ int FFMPEGVideoDecoder::Impl::hw_decoder_init(AVCodecContext *ctx, const enum AV
     return err;
 }
 
+int FFMPEGVideoDecoder::Impl::allocBuffers()
+{
+    if (packet == nullptr) packet = av_packet_alloc();
+    if (sw_frame == nullptr) sw_frame = av_frame_alloc();
+    while (frame_pool.size() < FFMPEG_DECODER_QUEUE_SIZE)
+    {
+        AVFrame *frame = av_frame_alloc();
+        if (frame == nullptr) break;
+        frame_pool.push_back(frame);
+    }
+    if (packet == nullptr || sw_frame == nullptr || frame_pool.size() < FFMPEG_DECODER_QUEUE_SIZE)
+    {
+        std::cerr << "Could not allocate decoder frames" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+void FFMPEGVideoDecoder::Impl::setThreads(int count, int type)
+{
+    if (count >= 0)
+    {
+        codec_ctx_->thread_count = count;
+    }
+    if (type == DECODER_THREAD_FRAME)
+    {
+        codec_ctx_->thread_type = FF_THREAD_FRAME;
+    }
+    else if (type == DECODER_THREAD_SLICE)
+    {
+        codec_ctx_->thread_type = FF_THREAD_SLICE;
+    }
+}
+
+AVBufferRef *FFMPEGVideoDecoder::Impl::getPacketBuffer(int size)
+{
+    // a new buffer only while frame threads still hold every existing one, or when a
+    // packet is larger than every previous one
+    size += AV_INPUT_BUFFER_PADDING_SIZE;
+    for (auto& buf: packet_bufs)
+    {
+        if (!av_buffer_is_writable(buf) || (packet != nullptr && packet->buf == buf) ||
+            (parsed != nullptr && parsed->buf == buf))
+        {
+            continue;
+        }
+        if (buf->size < size && av_buffer_realloc(&buf, FFMAX(size, buf->size * 3 / 2)) < 0)
+        {
+            return nullptr;
+        }
+        return buf;
+    }
+    AVBufferRef *buf = nullptr;
+    if (av_buffer_realloc(&buf, size) < 0)
+    {
+        return nullptr;
+    }
+    packet_bufs.push_back(buf);
+    return buf;
+}
+
+int FFMPEGVideoDecoder::Impl::fillPacket(AVPacket *pack, const uint8_t *data, int size, int64_t pts, int64_t dts)
+{
+    // copy into a reused, padded buffer so the packet is refcounted and
+    // avcodec_send_packet only references it instead of duplicating the data
+    pack->buf = getPacketBuffer(size);
+    if (pack->buf == nullptr)
+    {
+        std::cerr << "Could not allocate packet buffer" << std::endl;
+        return AVERROR(ENOMEM);
+    }
+    memcpy(pack->buf->data, data, size);
+    memset(pack->buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    pack->data = pack->buf->data;
+    pack->size = size;
+    pack->pts = pts;
+    pack->dts = dts;
+    pack->flags |= AV_PKT_FLAG_TRUSTED;
+    return 0;
+}
+
+void FFMPEGVideoDecoder::Impl::dropPacket(AVPacket *pack)
+{
+    // the buffer belongs to packet_bufs, not to the packet
+    pack->buf = nullptr;
+    av_packet_unref(pack);
+}
+
+int FFMPEGVideoDecoder::Impl::initParser()
+{
+    if (parser != nullptr)
+    {
+        return 0;
+    }
+    // hardware decoders like h264_cuvid still report the plain codec id
+    parser = av_parser_init(codec_ctx_->codec_id);
+    if (parsed == nullptr)
+    {
+        parsed = av_packet_alloc();
+    }
+    if (parser == nullptr || parsed == nullptr)
+    {
+        std::cerr << "no parser for codec " << codec_ctx_->codec_id << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int FFMPEGVideoDecoder::Impl::sendParsed()
+{
+    if (parsed == nullptr || parsed->size <= 0)
+    {
+        return DECODE_OK;
+    }
+    int ret = avcodec_send_packet(codec_ctx_, parsed);
+    if (ret == AVERROR(EAGAIN))
+    {
+        pullFrames();
+        ret = avcodec_send_packet(codec_ctx_, parsed);
+    }
+    if (ret == AVERROR(EAGAIN))
+    {
+        // queue is full, kept until frames are received
+        return DECODE_AGAIN;
+    }
+    dropPacket(parsed);
+    if (ret < 0)
+    {
+        // a broken access unit, e.g. when joining a live stream, must not stop the rest
+        std::cerr << "avcodec_send_packet error:" << ret << std::endl;
+    }
+    return DECODE_OK;
+}
+
+int FFMPEGVideoDecoder::Impl::parseStream(const uint8_t *data, int size, bool flushing, int &used)
+{
+    // stops with DECODE_AGAIN when the codec is full, used tells how far it got
+    used = 0;
+    while (true)
+    {
+        int ret = sendParsed();
+        if (ret != DECODE_OK)
+        {
+            return ret;
+        }
+        if (used >= size && !flushing)
+        {
+            return DECODE_OK;
+        }
+
+        uint8_t *out = nullptr;
+        int out_size = 0;
+        // empty input once everything is used makes the parser give out its last access unit
+        int len = av_parser_parse2(parser, codec_ctx_, &out, &out_size,
+                                   used < size ? data + used : nullptr, size - used,
+                                   stream_pts, stream_dts, 0);
+        // the timestamps belong to the start of the chunk only
+        stream_pts = AV_NOPTS_VALUE;
+        stream_dts = AV_NOPTS_VALUE;
+        if (len < 0)
+        {
+            std::cerr << "av_parser_parse2 error:" << len << std::endl;
+            return len;
+        }
+        used += len;
 
-static inline void YUV420P2BGR(uint8_t* yuv420p, int w, int h, uint8_t* bgr) {
-    int frameSize = w * h;
-    int yIndex = 0;
-    int uIndex = frameSize;
-    int vIndex = frameSize + (frameSize / 4);
-
-    #pragma omp parallel for
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            uint8_t Y = yuv420p[yIndex++];
-            uint8_t U = yuv420p[uIndex + (i / 2) * (w / 2) + (j / 2)];
-            uint8_t V = yuv420p[vIndex + (i / 2) * (w / 2) + (j / 2)];
-            // ITU-R BT.601 conversion
-            int R = 1.164 * (Y - 16) + 1.596 * (V - 128);
-            int G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128);
-            int B = 1.164 * (Y - 16) + 2.018 * (U - 128);
-            // Clamp to [0, 255]
-            R = R < 0 ? 0 : (R > 255 ? 255 : R);
-            G = G < 0 ? 0 : (G > 255 ? 255 : G);
-            B = B < 0 ? 0 : (B > 255 ? 255 : B);
-            // Store BGR
-            bgr[(i * w + j) * 3 + 0] = B;
-            bgr[(i * w + j) * 3 + 1] = G;
-            bgr[(i * w + j) * 3 + 2] = R;
+        if (out_size > 0)
+        {
+            ret = fillPacket(parsed, out, out_size, parser->pts, parser->dts);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            if (parser->key_frame == 1)
+            {
+                parsed->flags |= AV_PKT_FLAG_KEY;
+            }
         }
+        else if (used >= size)
+        {
+            return DECODE_OK;
+        }
+    }
+}
+
+int FFMPEGVideoDecoder::Impl::feedStream(bool flushing)
+{
+    if (parser == nullptr)
+    {
+        return DECODE_OK;
     }
+    int used = 0;
+    int ret = parseStream(stream_rest.data() + stream_pos, (int)(stream_rest.size() - stream_pos), flushing, used);
+    stream_pos += used;
+    if (stream_pos >= stream_rest.size())
+    {
+        stream_rest.clear();
+        stream_pos = 0;
+    }
+    return ret;
+}
+
+bool FFMPEGVideoDecoder::Impl::streamPending()
+{
+    return (parsed != nullptr && parsed->size > 0) || stream_pos < stream_rest.size();
 }
 
-static inline void NV12_2_BGR(uint8_t* nv12, int w, int h, uint8_t* bgr) {
-    int frameSize = w * h;
-    int yIndex = 0;
-    int uvIndex = frameSize;
-
-    #pragma omp parallel for
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            uint8_t Y = nv12[yIndex++];
-            uint8_t U = nv12[uvIndex + (i / 2) * w + (j / 2) * 2];
-            uint8_t V = nv12[uvIndex + (i / 2) * w + (j / 2) * 2 + 1];
-            // ITU-R BT.601 conversion
-            int R = 1.164 * (Y - 16) + 1.596 * (V - 128);
-            int G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128);
-            int B = 1.164 * (Y - 16) + 2.018 * (U - 128);
-            // Clamp to [0, 255]
-            R = R < 0 ? 0 : (R > 255 ? 255 : R);
-            G = G < 0 ? 0 : (G > 255 ? 255 : G);
-            B = B < 0 ? 0 : (B > 255 ? 255 : B);
-            // Store BGR
-            bgr[(i * w + j) * 3 + 0] = B;
-            bgr[(i * w + j) * 3 + 1] = G;
-            bgr[(i * w + j) * 3 + 2] = R;
+void FFMPEGVideoDecoder::Impl::resetStream()
+{
+    if (parser != nullptr)
+    {
+        av_parser_close(parser);
+        parser = nullptr;
+    }
+    if (parsed != nullptr)
+    {
+        dropPacket(parsed);
+    }
+    stream_rest.clear();
+    stream_pos = 0;
+    stream_pts = AV_NOPTS_VALUE;
+    stream_dts = AV_NOPTS_VALUE;
+}
+
+int FFMPEGVideoDecoder::Impl::transferHWFrame(AVFrame *hwFrame)
+{
+    // keep the buffers of sw_frame while size and format stay the same,
+    // av_hwframe_transfer_data only allocates when dst has no buffer
+    int sw_format = ((AVHWFramesContext *)hwFrame->hw_frames_ctx->data)->sw_format;
+    if (sw_frame->buf[0] == nullptr || sw_frame->format != sw_format ||
+        sw_frame->width != hwFrame->width || sw_frame->height != hwFrame->height ||
+        !av_frame_is_writable(sw_frame))
+    {
+        av_frame_unref(sw_frame);
+        sw_frame->format = sw_format;
+        sw_frame->width = hwFrame->width;
+        sw_frame->height = hwFrame->height;
+        int ret = av_frame_get_buffer(sw_frame, 0);
+        if (ret < 0)
+        {
+            return ret;
         }
     }
+    return av_hwframe_transfer_data(sw_frame, hwFrame, 0);
 }
 
-cv::Mat FFMPEGVideoDecoder::Impl::AVFrameToCVMat(AVFrame *frame)
+AVFrame *FFMPEGVideoDecoder::Impl::getFrame()
 {
-    // std::cout << frame->format << std::endl;
-    if (AV_PIX_FMT_YUV420P == frame->format || AV_PIX_FMT_YUVJ420P == frame->format)  // YUV420 to BGR
+    if (frame_pool.empty())
     {
-        uint8_t* buffer = (uint8_t*)av_malloc(codec_ctx_->width * codec_ctx_->height * 3 / 2);
-        // std::cout << frame->width << "," << frame->height << std::endl;
-        int frame_size = frame->width * frame->height;
+        return nullptr;
+    }
+    AVFrame *frame = frame_pool.back();
+    frame_pool.pop_back();
+    return frame;
+}
 
-        memcpy(buffer, frame->data[0], frame_size);
-        memcpy(buffer + frame_size, frame->data[1], frame_size/4);
-        memcpy(buffer + frame_size * 5/4, frame->data[2], frame_size/4);
+void FFMPEGVideoDecoder::Impl::recycleFrame(AVFrame *frame)
+{
+    av_frame_unref(frame);
+    frame_pool.push_back(frame);
+}
 
-        cv::Mat img(codec_ctx_->height * 3 / 2, codec_ctx_->width, CV_8UC1, buffer);
+int FFMPEGVideoDecoder::Impl::pullFrames()
+{
+    // move every ready frame out of the codec, so the next avcodec_send_packet does not get EAGAIN
+    while (frame_queue.size() < FFMPEG_DECODER_QUEUE_SIZE)
+    {
+        AVFrame *frame = getFrame();
+        if (frame == nullptr)
+        {
+            break;
+        }
+        int ret = avcodec_receive_frame(codec_ctx_, frame);
+        if (ret < 0)
+        {
+            recycleFrame(frame);
+            if (ret == AVERROR_EOF)
+            {
+                eof = true;
+                return 0;
+            }
+            if (ret != AVERROR(EAGAIN))
+            {
+                std::cerr << "avcodec_receive_frame error:" << ret << std::endl;
+                return ret;
+            }
+            return 0;
+        }
+        frame_queue.push_back(frame);
+    }
+    return 0;
+}
+
+void FFMPEGVideoDecoder::Impl::clearQueue()
+{
+    while (!frame_queue.empty())
+    {
+        recycleFrame(frame_queue.front());
+        frame_queue.pop_front();
+    }
+}
 
-        cv::Mat rgbImg(cv::Size(codec_ctx_->width, codec_ctx_->height), CV_8UC3);
-        YUV420P2BGR(img.data, codec_ctx_->width, codec_ctx_->height, rgbImg.data);
+void FFMPEGVideoDecoder::Impl::release()
+{
+    clearQueue();
+    for (auto frame: frame_pool)
+    {
+        av_frame_free(&frame);
+    }
+    frame_pool.clear();
+    draining = false;
+    eof = false;
+    resetStream();
+    if (packet != nullptr)
+    {
+        dropPacket(packet);
+    }
+    av_packet_free(&parsed);
+    av_packet_free(&packet);
+    av_frame_free(&sw_frame);
+    av_frame_free(&conv_frame);
+    sws_freeContext(sws_ctx);
+    sws_ctx = nullptr;
+    for (auto& buf: packet_bufs)
+    {
+        av_buffer_unref(&buf);
+    }
+    packet_bufs.clear();
+    avcodec_free_context(&codec_ctx_);
+    av_buffer_unref(&hw_device_ctx);
+    hw_pix_fmt = AV_PIX_FMT_NONE;
+    enable_hwaccel_ = false;
+    hw_type = HW_TYPE_NONE;
+}
 
-        // cv::cvtColor(img, img, cv::COLOR_YUV2BGR_I420);
-        av_freep(&buffer);
-        return rgbImg;
+
+int FFMPEGVideoDecoder::Impl::AVFrameToCVMat(AVFrame *frame, cv::Mat &outMat)
+{
+    // read planes in place with their own linesize, outMat is only reallocated when size changes
+    if (AV_PIX_FMT_YUV420P == frame->format || AV_PIX_FMT_YUVJ420P == frame->format)  // YUV420 to BGR
+    {
+        outMat.create(frame->height, frame->width, CV_8UC3);
+        easyvideo::YUV420P2BGR(
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->data[2], frame->linesize[2],
+            outMat.data, outMat.step, frame->width, frame->height
+        );
+        return 0;
     }
     else if (AV_PIX_FMT_NV12 == frame->format) // NV12 to BGR
     {
-        uint8_t* buffer = (uint8_t*)av_malloc(codec_ctx_->width * codec_ctx_->height * 3 / 2);
-        // std::cout << frame->width << "," << frame->height << std::endl;
-        int frame_size = frame->width * frame->height;
+        outMat.create(frame->height, frame->width, CV_8UC3);
+        easyvideo::NV12_2_BGR(
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            outMat.data, outMat.step, frame->width, frame->height
+        );
+        return 0;
+    }
+    else
+    {
+        std::cerr << "unsupported format:" << frame->format << std::endl;
+        return -1;
+    }
+}
 
-        memcpy(buffer, frame->data[0], frame_size);
-        memcpy(buffer + frame_size, frame->data[1], frame_size / 2);
 
-        cv::Mat img(codec_ctx_->height * 3 / 2, codec_ctx_->width, CV_8UC1, buffer);
-        cv::Mat rgbImg(cv::Size(codec_ctx_->width, codec_ctx_->height), CV_8UC3);
-        // cv::cvtColor(img, img, cv::COLOR_YUV2BGR_NV12);
-        NV12_2_BGR(img.data, codec_ctx_->width, codec_ctx_->height, rgbImg.data);
-        av_freep(&buffer);
-        return img;
+int FFMPEGVideoDecoder::Impl::AVFrameToYUVMat(AVFrame *frame, cv::Mat &outMat, int format)
+{
+    bool planar = AV_PIX_FMT_YUV420P == frame->format || AV_PIX_FMT_YUVJ420P == frame->format;
+    if (!planar && AV_PIX_FMT_NV12 != frame->format)
+    {
+        std::cerr << "unsupported format:" << frame->format << std::endl;
+        return -1;
+    }
+
+    int w = frame->width, h = frame->height;
+    int cw = w / 2, ch = h / 2;
+    outMat.create(h * 3 / 2, w, CV_8UC1);
+
+    uint8_t* dst = outMat.data;
+    for (int i = 0; i < h; i++, dst += w)
+    {
+        memcpy(dst, frame->data[0] + i * frame->linesize[0], w);
+    }
+
+    if (format == VIDEO_FRAME_NV12)
+    {
+        for (int i = 0; i < ch; i++, dst += 2 * cw)
+        {
+            if (planar)
+            {
+                const uint8_t* u = frame->data[1] + i * frame->linesize[1];
+                const uint8_t* v = frame->data[2] + i * frame->linesize[2];
+                for (int j = 0; j < cw; j++)
+                {
+                    dst[2 * j] = u[j];
+                    dst[2 * j + 1] = v[j];
+                }
+            }
+            else
+            {
+                memcpy(dst, frame->data[1] + i * frame->linesize[1], 2 * cw);
+            }
+        }
+    }
+    else  // I420
+    {
+        uint8_t* dst_v = dst + cw * ch;
+        for (int i = 0; i < ch; i++, dst += cw, dst_v += cw)
+        {
+            if (planar)
+            {
+                memcpy(dst, frame->data[1] + i * frame->linesize[1], cw);
+                memcpy(dst_v, frame->data[2] + i * frame->linesize[2], cw);
+            }
+            else
+            {
+                const uint8_t* uv = frame->data[1] + i * frame->linesize[1];
+                for (int j = 0; j < cw; j++)
+                {
+                    dst[j] = uv[2 * j];
+                    dst_v[j] = uv[2 * j + 1];
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int FFMPEGVideoDecoder::Impl::AVFrameToLetterboxMat(AVFrame *frame, cv::Mat &outMat, cv::Size size, float &ratio)
+{
+    // scale, convert and pad in one pass instead of AVFrameToCVMat + static_resize
+    if (AV_PIX_FMT_YUV420P == frame->format || AV_PIX_FMT_YUVJ420P == frame->format)
+    {
+        outMat.create(size, CV_8UC3);
+        ratio = easyvideo::letterboxYUV420P2BGR(
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->data[2], frame->linesize[2],
+            frame->width, frame->height,
+            outMat.data, outMat.step, size.width, size.height
+        );
+        return 0;
+    }
+    else if (AV_PIX_FMT_NV12 == frame->format)
+    {
+        outMat.create(size, CV_8UC3);
+        ratio = easyvideo::letterboxNV12_2_BGR(
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->width, frame->height,
+            outMat.data, outMat.step, size.width, size.height
+        );
+        return 0;
     }
     else
     {
         std::cerr << "unsupported format:" << frame->format << std::endl;
-        return cv::Mat();
+        return -1;
     }
 }
 
+AVFrame *FFMPEGVideoDecoder::Impl::toSupportedFormat(AVFrame *frame)
+{
+    if (AV_PIX_FMT_YUV420P == frame->format || AV_PIX_FMT_YUVJ420P == frame->format || AV_PIX_FMT_NV12 == frame->format)
+    {
+        return frame;
+    }
+    // e.g. 4:2:2 or 10 bit after the camera changed its profile. the cached context
+    // and conv_frame are rebuilt when size or format change
+    sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                   frame->width, frame->height, AV_PIX_FMT_YUV420P,
+                                   SWS_BILINEAR, NULL, NULL, NULL);
+    if (sws_ctx == nullptr)
+    {
+        std::cerr << "unsupported format:" << frame->format << std::endl;
+        return nullptr;
+    }
+    if (conv_frame == nullptr)
+    {
+        conv_frame = av_frame_alloc();
+        if (conv_frame == nullptr)
+        {
+            return nullptr;
+        }
+    }
+    if (conv_frame->buf[0] == nullptr || conv_frame->width != frame->width || conv_frame->height != frame->height)
+    {
+        av_frame_unref(conv_frame);
+        conv_frame->format = AV_PIX_FMT_YUV420P;
+        conv_frame->width = frame->width;
+        conv_frame->height = frame->height;
+        if (av_frame_get_buffer(conv_frame, 0) < 0)
+        {
+            return nullptr;
+        }
+    }
+    sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, conv_frame->data, conv_frame->linesize);
+    return conv_frame;
+}
+
+int FFMPEGVideoDecoder::Impl::frameToMat(AVFrame *frame, cv::Mat &outMat, int format, cv::Size letterbox, float &ratio)
+{
+    frame = toSupportedFormat(frame);
+    if (frame == nullptr)
+    {
+        return -1;
+    }
+    if (format == VIDEO_FRAME_I420 || format == VIDEO_FRAME_NV12)
+    {
+        return AVFrameToYUVMat(frame, outMat, format);
+    }
+    if (letterbox.width > 0 && letterbox.height > 0)
+    {
+        return AVFrameToLetterboxMat(frame, outMat, letterbox, ratio);
+    }
+    return AVFrameToCVMat(frame, outMat);
+}
+
 
 // ------------------------------------------------------------------------------------------------
 
-int FFMPEGVideoDecoder::decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll)
+FFMPEGVideoDecoder::~FFMPEGVideoDecoder()
+{
+    if (impl_ != nullptr)
+    {
+        impl_->release();
+        delete impl_;
+        impl_ = nullptr;
+    }
+}
+
+int FFMPEGVideoDecoder::sendPacket(uint8_t *inData, int inLen, int64_t pts, int64_t dts)
 {
+    if (impl_ == nullptr || impl_->codec_ctx_ == nullptr)
+    {
+        std::cerr << "decoder not init!" << std::endl;
+        return -1;
+    }
+
+    if (inData == nullptr || inLen <= 0)
+    {
+        // end of stream, the remaining frames come out of receiveFrame
+        if (!impl_->draining)
+        {
+            // stream mode, the last access unit is still in the parser
+            int ret = impl_->feedStream(true);
+            if (ret != DECODE_OK)
+            {
+                return ret;
+            }
+            avcodec_send_packet(impl_->codec_ctx_, NULL);
+            impl_->draining = true;
+        }
+        return impl_->pullFrames();
+    }
+    if (impl_->draining)
+    {
+        std::cerr << "decoder is draining, call flush() before sending new packets" << std::endl;
+        return AVERROR_EOF;
+    }
+
+    switch (decode_mode_)
+    {
+    case DECODE_MODE_KEYFRAME:
+        impl_->codec_ctx_->skip_frame = AVDISCARD_NONKEY;
+        break;
+    case DECODE_MODE_NONREF:
+        impl_->codec_ctx_->skip_frame = AVDISCARD_NONREF;
+        break;
+    default:
+        impl_->codec_ctx_->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    }
 
-    AVPacket pack;
-    memset(&pack, 0, sizeof(pack));
-    // pack.data = inData;
-    // pack.size = inLen;
-    av_packet_from_data(&pack, inData, inLen);
+    if (stream_mode_)
+    {
+        return sendStream(inData, inLen, pts, dts);
+    }
 
-    pack.flags |= AV_PKT_FLAG_TRUSTED;
+    AVPacket *pack = impl_->packet;
+    int ret = impl_->fillPacket(pack, inData, inLen, pts, dts);
+    if (ret < 0)
+    {
+        return ret;
+    }
 
-    int ret = 0;
-    ret = avcodec_send_packet(impl_->codec_ctx_, &pack);
-    if (ret != 0){
+    ret = avcodec_send_packet(impl_->codec_ctx_, pack);
+    if (ret == AVERROR(EAGAIN))
+    {
+        impl_->pullFrames();
+        ret = avcodec_send_packet(impl_->codec_ctx_, pack);
+    }
+    impl_->dropPacket(pack);
+    if (ret == AVERROR(EAGAIN))
+    {
+        // queue is full
+        return DECODE_AGAIN;
+    }
+    if (ret < 0)
+    {
         std::cerr << "avcodec_send_packet error:" << ret << std::endl;
         return ret;
     }
+    return impl_->pullFrames();
+}
 
-    AVFrame *frame = av_frame_alloc();
-    ret = avcodec_receive_frame(impl_->codec_ctx_, frame);
-    if (ret != 0){
-        if (ret != -11)
-        {
-            std::cerr << "avcodec_receive_frame error:" << ret << std::endl;
-        }
-        av_frame_free(&frame);
+int FFMPEGVideoDecoder::sendStream(uint8_t *inData, int inLen, int64_t pts, int64_t dts)
+{
+    if (impl_->initParser() < 0)
+    {
+        return -1;
+    }
+    // the rest of the previous chunk goes first, this one is not taken while it does not fit
+    int ret = impl_->feedStream(false);
+    if (ret != DECODE_OK)
+    {
         return ret;
     }
 
-    if (readAll)
+    impl_->stream_pts = pts;
+    impl_->stream_dts = dts;
+    int used = 0;
+    ret = impl_->parseStream(inData, inLen, false, used);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (used < inLen)
     {
-        AVFrame *frame2 = av_frame_alloc();
-        ret = 0;
-        while (ret == 0)
+        // parsed by later sendPacket or receiveFrame calls
+        impl_->stream_rest.assign(inData + used, inData + inLen);
+        impl_->stream_pos = 0;
+    }
+    return impl_->pullFrames();
+}
+
+int FFMPEGVideoDecoder::receiveFrame(cv::Mat &outMatV)
+{
+    int64_t pts;
+    int ret = peekFrame(pts);
+    if (ret != DECODE_OK)
+    {
+        return ret;
+    }
+
+    AVFrame *frame = impl_->frame_queue.front();
+    impl_->frame_queue.pop_front();
+    // converters and sw_frame follow the size of each frame, not of codec_ctx_
+    updateFrameSize(frame->width, frame->height);
+    ret = convertFrame(frame, outMatV);
+    impl_->recycleFrame(frame);
+    return ret;
+}
+
+int FFMPEGVideoDecoder::peekFrame(int64_t &pts)
+{
+    if (impl_ == nullptr || impl_->codec_ctx_ == nullptr)
+    {
+        std::cerr << "decoder not init!" << std::endl;
+        return -1;
+    }
+
+    if (impl_->frame_queue.empty())
+    {
+        int ret = impl_->pullFrames();
+        if (ret < 0)
         {
-            ret = avcodec_receive_frame(impl_->codec_ctx_, frame2);
+            return ret;
         }
-        av_frame_free(&frame2);
+    }
+    if (impl_->frame_queue.empty() && impl_->streamPending())
+    {
+        // stream mode, input held back while the codec was full
+        int ret = impl_->feedStream(false);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        ret = impl_->pullFrames();
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    if (impl_->frame_queue.empty())
+    {
+        return impl_->eof ? DECODE_EOF : DECODE_AGAIN;
     }
 
+    AVFrame *frame = impl_->frame_queue.front();
+    pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    return DECODE_OK;
+}
 
-    if (impl_->enable_hwaccel_)
+int FFMPEGVideoDecoder::skipFrame()
+{
+    int64_t pts;
+    int ret = peekFrame(pts);
+    if (ret != DECODE_OK)
     {
-        AVFrame *sw_frame = av_frame_alloc();
-        AVFrame *tmp_frame = NULL;
-        // uint8_t *buffer = NULL;
-        // int size;
+        return ret;
+    }
+    impl_->recycleFrame(impl_->frame_queue.front());
+    impl_->frame_queue.pop_front();
+    return DECODE_OK;
+}
 
-        if (frame->format == hw_pix_fmt)
+int FFMPEGVideoDecoder::flush()
+{
+    if (impl_ == nullptr || impl_->codec_ctx_ == nullptr)
+    {
+        return -1;
+    }
+    impl_->clearQueue();
+    impl_->resetStream();
+    avcodec_flush_buffers(impl_->codec_ctx_);
+    impl_->draining = false;
+    impl_->eof = false;
+    return 0;
+}
+
+int FFMPEGVideoDecoder::convertFrame(AVFrame *frame, cv::Mat &outMatV)
+{
+    AVFrame *tmp_frame = frame;
+    if (impl_->enable_hwaccel_ && frame->hw_frames_ctx != nullptr)
+    {
+        int ret = impl_->transferHWFrame(frame);
+        if (ret < 0)
         {
-            if ((ret = av_hwframe_transfer_data(sw_frame, frame, 0)) < 0)
-            {
-                std::cerr << "Failed to transfer the data to system memory." << std::endl;
-                av_frame_free(&sw_frame);
-                av_frame_free(&frame);
-                return ret;
-            }
-            tmp_frame = sw_frame;
+            std::cerr << "Failed to transfer the data to system memory." << std::endl;
+            return ret;
         }
-        else
+        tmp_frame = impl_->sw_frame;
+    }
+
+    // std::cout << "frame_format:" << tmp_frame->format << std::endl;
+    return impl_->frameToMat(tmp_frame, outMatV, output_format_, letterbox_size_, letterbox_ratio_);
+}
+
+int FFMPEGVideoDecoder::decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll)
+{
+    int ret = sendPacket(inData, inLen);
+    // the queue is full: hand out the oldest frame and drop newer ones until the codec takes
+    // the packet, a lost packet would break every frame up to the next keyframe
+    bool received = false;
+    while (ret == DECODE_AGAIN)
+    {
+        ret = received ? skipFrame() : receiveFrame(outMatV);
+        if (ret != DECODE_OK)
         {
-            tmp_frame = frame;
+            std::cerr << "decoder does not take the packet and gives no frame" << std::endl;
+            return ret < 0 ? ret : AVERROR(EAGAIN);
         }
+        received = true;
+        ret = sendPacket(inData, inLen);
+    }
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (received)
+    {
+        return 0;
+    }
 
-        // std::cout << "hw2sw_frame_format:" << tmp_frame->format << std::endl;
-
-        outMatV = impl_->AVFrameToCVMat(tmp_frame);
-        av_frame_free(&sw_frame);
-        av_frame_free(&frame);
+    ret = receiveFrame(outMatV);
+    if (ret == DECODE_AGAIN)
+    {
+        return AVERROR(EAGAIN);
     }
-    else
+    if (ret != DECODE_OK)
     {
-        // std::cout << "sw_frame_format:" << frame->format << std::endl;
-        outMatV = impl_->AVFrameToCVMat(frame);
-        av_frame_free(&frame);
+        return ret;
+    }
+
+    if (readAll)
+    {
+        // only the first frame of the packet is wanted
+        impl_->clearQueue();
     }
     return 0;
 }
@@ -283,6 +997,7 @@ int FFMPEGVideoDecoder::open_codec(int width, int height, int fps, int decode_id
     {
         impl_ = new Impl();
     }
+    impl_->release();
 
     const AVCodec *codec;
     int hwtype = 0; // AV_HWDEVICE_TYPE_NONE;
@@ -396,7 +1111,7 @@ end_find_decoder:
                 && config->device_type == hwtype
             ) 
             {
-                hw_pix_fmt = config->pix_fmt;
+                impl_->hw_pix_fmt = config->pix_fmt;
                 // AV_PIX_FMT_NV12;
                 break;
             }
@@ -427,8 +1142,11 @@ end_find_decoder:
     }
     else
     {
-        impl_->codec_ctx_->pix_fmt = hw_pix_fmt;
-        impl_->codec_ctx_->get_format = get_hw_format;
+        impl_->codec_ctx_->pix_fmt = impl_->hw_pix_fmt;
+        impl_->codec_ctx_->opaque = impl_;
+        impl_->codec_ctx_->get_format = Impl::get_hw_format;
+        // hw surfaces held by the frame queue
+        impl_->codec_ctx_->extra_hw_frames = FFMPEG_DECODER_QUEUE_SIZE;
         av_opt_set_int(impl_->codec_ctx_, "refcounted_frames", 1, 0);
         if (impl_->hw_decoder_init(impl_->codec_ctx_, (AVHWDeviceType)hwtype) < 0)
         {
@@ -442,13 +1160,15 @@ end_find_decoder:
         
     }
     
+    impl_->setThreads(thread_count_, thread_type_);
+
     // std::cout << "open decoder" << std::endl;
     if (avcodec_open2(impl_->codec_ctx_, codec, NULL) < 0) {
         std::cout << "Could not open codec" << std::endl;
         return -1;
     }
     // std::cout << "open decoder success" << std::endl;
-    return 0;
+    return impl_->allocBuffers();
 
 }
 
@@ -478,6 +1198,7 @@ int FFMPEGVideoDecoder::open_codec(int width, int height, int fps, std::string d
     {
         impl_ = new Impl();
     }
+    impl_->release();
 
     const AVCodec *codec;
     int hwtype = 0; // AV_HWDEVICE_TYPE_NONE;
@@ -521,7 +1242,7 @@ end_find_decoder:
             if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) 
             {
                 hwtype = config->device_type;
-                hw_pix_fmt = config->pix_fmt;
+                impl_->hw_pix_fmt = config->pix_fmt;
                 break;
             }
         }
@@ -551,8 +1272,11 @@ end_find_decoder:
     }
     else
     {
-        impl_->codec_ctx_->pix_fmt = hw_pix_fmt;
-        impl_->codec_ctx_->get_format = get_hw_format;
+        impl_->codec_ctx_->pix_fmt = impl_->hw_pix_fmt;
+        impl_->codec_ctx_->opaque = impl_;
+        impl_->codec_ctx_->get_format = Impl::get_hw_format;
+        // hw surfaces held by the frame queue
+        impl_->codec_ctx_->extra_hw_frames = FFMPEG_DECODER_QUEUE_SIZE;
         av_opt_set_int(impl_->codec_ctx_, "refcounted_frames", 1, 0);
         if (impl_->hw_decoder_init(impl_->codec_ctx_, (AVHWDeviceType)hwtype) < 0)
         {
@@ -564,13 +1288,15 @@ end_find_decoder:
         
     }
     
+    impl_->setThreads(thread_count_, thread_type_);
+
     // std::cout << "open decoder" << std::endl;
     if (avcodec_open2(impl_->codec_ctx_, codec, NULL) < 0) {
         std::cout << "Could not open codec" << std::endl;
         return -1;
     }
     // std::cout << "open decoder success" << std::endl;
-    return 0;
+    return impl_->allocBuffers();
 
 }
 
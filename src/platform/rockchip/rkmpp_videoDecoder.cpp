@@ -1,4 +1,5 @@
 #include "easyvideo/videoDecoder.h"
+#include "easyvideo/utils/yuv2bgr.h"
 
 
 #include "rockchip/mpp_buffer.h"
@@ -12,39 +13,6 @@
 #include "rga/rga.h"
 // #include "rockchip/"
 #include <unordered_map>
-#include <omp.h>
-
-static inline void YUV420sp2BGR(uchar* yuv420sp, int w, int h, uchar* bgr) {
-    int frameSize = w * h;
-    int yIndex = 0;
-    int uvIndex = frameSize;
-
-    #pragma omp parallel for
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            uint8_t Y = yuv420sp[yIndex++];
-            uint8_t U = 0, V = 0;
-            if (i % 2 == 0 && j % 2 == 0) {
-                V = yuv420sp[uvIndex++];
-                U = yuv420sp[uvIndex++];
-            }
-            // ITU-R BT.601 conversion
-            int R = 1.164 * (Y - 16) + 1.596 * (V - 128);
-            int G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128);
-            int B = 1.164 * (Y - 16) + 2.018 * (U - 128);
-            // Clamp to [0, 255]
-            R = R < 0 ? 0 : (R > 255 ? 255 : R);
-            G = G < 0 ? 0 : (G > 255 ? 255 : G);
-            B = B < 0 ? 0 : (B > 255 ? 255 : B);
-            // Store BGR
-            bgr[(i * w + j) * 3 + 0] = B;
-            bgr[(i * w + j) * 3 + 1] = G;
-            bgr[(i * w + j) * 3 + 2] = R;
-        }
-    }
-}
-
-
 
 #ifdef SYLIXOS
 static inline bool YUV420sp2BGR_Mpp(MppFrame frame, int w, int h, uint8_t* bgr) {
@@ -98,11 +66,69 @@ static inline bool YUV420sp2BGR_Mpp(uint8_t* yuv, int w, int h, uint8_t* bgr) {
 #endif
 
 
-static inline void YUV420SP2Mat(MppFrame frame, cv::Mat& rgbImg) 
+// copy the nv12 frame without color conversion, format is VIDEO_FRAME_I420 or VIDEO_FRAME_NV12
+static inline void YUV420SP2YUVMat(MppFrame frame, cv::Mat& yuvImg, int format)
+{
+	RK_U32 width = mpp_frame_get_width(frame);
+	RK_U32 height = mpp_frame_get_height(frame);
+	RK_U32 h_stride = mpp_frame_get_hor_stride(frame);
+	RK_U32 v_stride = mpp_frame_get_ver_stride(frame);
+
+	RK_U8 *base_y = (RK_U8 *)mpp_buffer_get_ptr(mpp_frame_get_buffer(frame));
+	RK_U8 *base_c = base_y + h_stride * v_stride;
+
+	yuvImg.create(height * 3 / 2, width, CV_8UC1);
+	RK_U8 *dst = yuvImg.data;
+	for (RK_U32 i = 0; i < height; i++, base_y += h_stride, dst += width) {
+		memcpy(dst, base_y, width);
+	}
+
+	RK_U32 cw = width / 2;
+	RK_U8 *dst_v = dst + cw * (height / 2);
+	for (RK_U32 i = 0; i < height / 2; i++, base_c += h_stride) {
+		if (format == VIDEO_FRAME_NV12) {
+			memcpy(dst, base_c, 2 * cw);
+			dst += 2 * cw;
+			continue;
+		}
+		for (RK_U32 j = 0; j < cw; j++) {
+			dst[j] = base_c[2 * j];
+			dst_v[j] = base_c[2 * j + 1];
+		}
+		dst += cw;
+		dst_v += cw;
+	}
+}
+
+// scale + convert + pad the nv12 frame into size in one pass, return 1 / ratio like static_resize
+static inline float YUV420SP2LetterboxMat(MppFrame frame, cv::Mat& rgbImg, cv::Size size)
+{
+	RK_U32 width = mpp_frame_get_width(frame);
+	RK_U32 height = mpp_frame_get_height(frame);
+	RK_U32 h_stride = mpp_frame_get_hor_stride(frame);
+	RK_U32 v_stride = mpp_frame_get_ver_stride(frame);
+
+	RK_U8 *base_y = (RK_U8 *)mpp_buffer_get_ptr(mpp_frame_get_buffer(frame));
+	RK_U8 *base_c = base_y + h_stride * v_stride;
+
+	rgbImg.create(size, CV_8UC3);
+	return easyvideo::letterboxNV12_2_BGR(
+		base_y, h_stride, base_c, h_stride, width, height,
+		rgbImg.data, rgbImg.step, size.width, size.height
+	);
+}
+
+static inline void YUV420SP2Mat(MppFrame frame, cv::Mat& rgbImg, int format=VIDEO_FRAME_BGR) 
 {
 	RK_U32 width = 0;
 	RK_U32 height = 0;
 
+    if (format == VIDEO_FRAME_I420 || format == VIDEO_FRAME_NV12)
+    {
+        YUV420SP2YUVMat(frame, rgbImg, format);
+        return;
+    }
+
 	width = mpp_frame_get_width(frame);
 	height = mpp_frame_get_height(frame);
 
@@ -158,7 +184,11 @@ static inline void YUV420SP2Mat(MppFrame frame, cv::Mat& rgbImg)
     }
     std::cout << "failed to use rga conversion yuv420sp to bgr" << std::endl;
 #endif
-	YUV420sp2BGR(yuvImg.data, width, height, rgbImg.data);
+    easyvideo::NV12_2_BGR(
+        yuvImg.data, width,
+        yuvImg.data + width * height, width,
+        rgbImg.data, rgbImg.step, width, height
+    );
 }
 
 // -------------------------------------------------------
@@ -168,12 +198,16 @@ class RKMPPVideoDecoder: public VideoDecoder {
 public:
     RKMPPVideoDecoder() {}
 
+    ~RKMPPVideoDecoder();
+
     int open_codec(int width, int height, int fps, int decode_id=CODEC_H264);
 
     int open_codec(int width, int height, int fps, std::string decoder_name="");
 
     int decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll=false);
 
+    int flush();
+
 private:
     MppCtx ctx;
     MppApi *mpi = nullptr;
@@ -183,6 +217,8 @@ private:
 
     int frame_count = 0;
 
+    MppBufferGroup frm_grp = NULL;
+
     const std::unordered_map<int, MppCodingType> map_ = {
         {CODEC_AUTO, MPP_VIDEO_CodingAutoDetect},
         {CODEC_H264, MPP_VIDEO_CodingAVC},
@@ -192,6 +228,31 @@ private:
 };
     
 
+RKMPPVideoDecoder::~RKMPPVideoDecoder()
+{
+    if (init_)
+    {
+        mpi->reset(ctx);
+        mpp_destroy(ctx);
+        init_ = false;
+    }
+    if (frm_grp != NULL)
+    {
+        mpp_buffer_group_put(frm_grp);
+        frm_grp = NULL;
+    }
+}
+
+int RKMPPVideoDecoder::flush()
+{
+    VideoDecoder::flush();
+    if (init_)
+    {
+        mpi->reset(ctx);
+    }
+    return 0;
+}
+
 int RKMPPVideoDecoder::open_codec(int width, int height, int fps, int decode_id)
 {
     if (init_)
@@ -322,106 +383,110 @@ int RKMPPVideoDecoder::open_codec(int width, int height, int fps, std::string de
 
 int RKMPPVideoDecoder::decodeFrame(uint8_t *inData, int inLen, cv::Mat &outMatV, bool readAll)
 {
-    std::cout << __FILE__ << ":" << __LINE__ << " -> using rkmpp decoder" << std::endl;
+    if (!init_)
+    {
+        std::cerr << "decoder not init!" << std::endl;
+        return -1;
+    }
     RK_U32 pkt_done = 0;
-    RK_U32 pkt_eos  = 0;
     RK_U32 err_info = 0;
+    bool got_frame = false;
+    int times = 5;
     err = MPP_OK;
-    
+
     MppPacket packet = NULL;
     MppFrame  frame  = NULL;
-    MppBufferGroup frm_grp = NULL;
-    MppBufferGroup pkt_grp = NULL;
-    size_t read_size = 0;
-    size_t packet_size = inLen;
 
-    std::cout << __LINE__ << std::endl;
     err = mpp_packet_init(&packet, inData, inLen);
-    std::cout << __LINE__ << std::endl;
+    if (err != MPP_OK)
+    {
+        std::cerr << "mpp_packet_init failed with code " << err << std::endl;
+        return err;
+    }
     mpp_packet_set_pts(packet, 1e9 / fps_ * (++frame_count));
-    std::cout << __LINE__ << std::endl;
 
     do {
-        RK_S32 get_frm = 0;
-        RK_U32 frm_eos = 0;
-        int times = 5;
+        // mpp copies the packet, put it again while its input queue is full
+        if (!pkt_done && mpi->decode_put_packet(ctx, packet) == MPP_OK)
+        {
+            pkt_done = 1;
+        }
 
-        try_again:
-        std::cout << __LINE__ << std::endl;
         err = mpi->decode_get_frame(ctx, &frame);
-        std::cout << __LINE__ << std::endl;
-        if (MPP_ERR_TIMEOUT == err) {
-            if (times > 0) {
-                times--;
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                goto try_again;
+        if (MPP_ERR_TIMEOUT == err || (MPP_OK == err && frame == NULL))
+        {
+            if (pkt_done && (got_frame || times <= 0))
+            {
+                err = MPP_OK;
+                break;
             }
-            std::cerr << "decode_get_frame failed too much time\n";
-            break;
+            times--;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
         }
-        std::cout << __LINE__ << std::endl;
         if (MPP_OK != err) {
             fprintf(stderr, "decode_get_frame failed ret %d\n", err);
             break;
         }
-        std::cout << __LINE__ << std::endl;
 
-        if (frame) {
-            if (mpp_frame_get_info_change(frame)) {
-                RK_U32 width = mpp_frame_get_width(frame);
-                RK_U32 height = mpp_frame_get_height(frame);
-                RK_U32 hor_stride = mpp_frame_get_hor_stride(frame);
-                RK_U32 ver_stride = mpp_frame_get_ver_stride(frame);
-                RK_U32 buf_size = mpp_frame_get_buf_size(frame);
+        if (mpp_frame_get_info_change(frame)) {
+            RK_U32 width = mpp_frame_get_width(frame);
+            RK_U32 height = mpp_frame_get_height(frame);
+            RK_U32 hor_stride = mpp_frame_get_hor_stride(frame);
+            RK_U32 ver_stride = mpp_frame_get_ver_stride(frame);
+            RK_U32 buf_size = mpp_frame_get_buf_size(frame);
 
-                width_ = width;
-                height_ = height;
+            updateFrameSize(width, height);
 
-                printf("decode_get_frame get info changed found\n");
-                printf("decoder require buffer w:h [%d:%d] stride [%d:%d] buf_size %d",
-                        width, height, hor_stride, ver_stride, buf_size);
+            printf("decode_get_frame get info changed found\n");
+            printf("decoder require buffer w:h [%d:%d] stride [%d:%d] buf_size %d\n",
+                    width, height, hor_stride, ver_stride, buf_size);
 
+            if (frm_grp == NULL)
+            {
                 err = mpp_buffer_group_get_internal(&frm_grp, MPP_BUFFER_TYPE_ION);
                 if (err) {
                     fprintf(stderr, "get mpp buffer group  failed ret %d\n", err);
+                    mpp_frame_deinit(&frame);
                     break;
                 }
-                mpi->control(ctx, MPP_DEC_SET_EXT_BUF_GROUP, frm_grp);
-                mpi->control(ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
-            } else {
-                err_info = mpp_frame_get_errinfo(frame) | mpp_frame_get_discard(frame);
-                if (err_info) {
-                    fprintf(stderr, "decoder_get_frame get err info:%d discard:%d.\n",
-                            mpp_frame_get_errinfo(frame), mpp_frame_get_discard(frame));
-                }
-                frame_count++;
-                
-                if (!err_info)
+            }
+            mpi->control(ctx, MPP_DEC_SET_EXT_BUF_GROUP, frm_grp);
+            mpi->control(ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
+        } else {
+            err_info = mpp_frame_get_errinfo(frame) | mpp_frame_get_discard(frame);
+            if (err_info) {
+                fprintf(stderr, "decoder_get_frame get err info:%d discard:%d.\n",
+                        mpp_frame_get_errinfo(frame), mpp_frame_get_discard(frame));
+            }
+            else
+            {
+                // with readAll the latest frame is kept
+                if (output_format_ == VIDEO_FRAME_BGR && letterbox_size_.width > 0 && letterbox_size_.height > 0)
                 {
-                    YUV420SP2Mat(frame, outMatV);
-                    if (!readAll) return MPP_OK;
+                    letterbox_ratio_ = YUV420SP2LetterboxMat(frame, outMatV, letterbox_size_);
                 }
-                else if (!readAll)
+                else
                 {
-                    return err_info;
+                    YUV420SP2Mat(frame, outMatV, output_format_);
                 }
+                got_frame = true;
             }
-            frm_eos = mpp_frame_get_eos(frame);
-            mpp_frame_deinit(&frame);
-
-            frame = NULL;
-            get_frm = 1;
         }
-        else
+        mpp_frame_deinit(&frame);
+        frame = NULL;
+
+        if (pkt_done && got_frame && !readAll)
         {
-            if (times > 0) {
-                times--;
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                goto try_again;
-            }
             break;
         }
     } while (1);
 
-    return err;
+    mpp_packet_deinit(&packet);
+    if (err != MPP_OK)
+    {
+        return err;
+    }
+    // a frame mpp discarded (err_info) is reported above, decoding goes on with the next packet
+    return got_frame ? MPP_OK : -EAGAIN;
 }
@@ -1,4 +1,5 @@
 #include "easyvideo/push.h"
+#include "easyvideo/utils/yuv2bgr.h"
 
 // #define ENABLE_RKMPP
 #ifdef ENABLE_RKMPP
@@ -62,9 +63,15 @@ namespace easyvideo
 {
 AVFrame *RTSPPusher::CVMatToAVFrame(cv::Mat &inMat, int YUV_TYPE) {
     //得到Mat信息
+    bool isYUV = YUV_TYPE == VIDEO_FRAME_I420 || YUV_TYPE == VIDEO_FRAME_NV12;
     AVPixelFormat dstFormat = AV_PIX_FMT_YUV420P;
     int width = inMat.cols;
-    int height = inMat.rows;
+    int height = isYUV ? inMat.rows * 2 / 3 : inMat.rows;
+    if (isYUV && (inMat.type() != CV_8UC1 || !inMat.isContinuous()))
+    {
+        std::cerr << "yuv input should be a continuous CV_8UC1 mat with height * 3 / 2 rows" << std::endl;
+        return nullptr;
+    }
     //创建AVFrame填充参数 注：调用者释放该frame
     AVFrame *frame = av_frame_alloc();
     frame->width = width;
@@ -75,35 +82,50 @@ AVFrame *RTSPPusher::CVMatToAVFrame(cv::Mat &inMat, int YUV_TYPE) {
     int ret = av_frame_get_buffer(frame, 64);
     if (ret < 0)
     {
+        av_frame_free(&frame);
         return nullptr;
     }
     ret = av_frame_make_writable(frame);
     if (ret < 0)
     {
+        av_frame_free(&frame);
         return nullptr;
     }
 
-    //转换颜色空间为YUV420
-    cv::Mat yuv(cv::Size(width, (int)(height * 3 / 2)), CV_8UC1);
-
-
+    cv::Mat yuv;
+    if (isYUV)
+    {
+        // already yuv, no color conversion
+        yuv = inMat;
+    }
+    else
+    {
+        //转换颜色空间为YUV420
+        yuv.create(cv::Size(width, (int)(height * 3 / 2)), CV_8UC1);
 #ifdef ENABLE_RKMPP
-    // std::cout << "using rga converter\n";
-    BGR2YUV420_Mpp(inMat, width, height, yuv.data);
+        // std::cout << "using rga converter\n";
+        BGR2YUV420_Mpp(inMat, width, height, yuv.data);
 #else
-    cv::cvtColor(inMat, yuv, cv::COLOR_BGR2YUV_I420);
+        cv::cvtColor(inMat, yuv, cv::COLOR_BGR2YUV_I420);
 #endif
-    
+    }
 
     //按YUV420格式，设置数据地址
-    int frame_size = width * height;
-    memcpy(frame->data[0], yuv.data, frame_size);
-    memcpy(frame->data[1], yuv.data + frame_size, frame_size/4);
-    memcpy(frame->data[2], yuv.data + frame_size * 5/4, frame_size/4);
+    easyvideo::splitYUV420(
+        yuv.data, width, height, YUV_TYPE == VIDEO_FRAME_NV12,
+        frame->data[0], frame->linesize[0],
+        frame->data[1], frame->linesize[1],
+        frame->data[2], frame->linesize[2]
+    );
 
     return frame;
 }
 
+void RTSPPusher::setInputFormat(int format)
+{
+    input_format_ = format;
+}
+
 bool RTSPPusher::isConnected()
 {
     return outputConnected_;
@@ -149,7 +171,11 @@ int RTSPPusher::push() {
             break;
         }
         // std::cout << 2 << std::endl;
-        yuv = CVMatToAVFrame(frame, 0);
+        yuv = CVMatToAVFrame(frame, input_format_);
+        if (yuv == nullptr)
+        {
+            continue;
+        }
 
         yuv->pts = pts;
         pts += 1;
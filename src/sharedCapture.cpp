@@ -0,0 +1,272 @@
+#ifndef SHARED_CAPTURE_CPP
+#define SHARED_CAPTURE_CPP
+
+#include "easyvideo/opencv/sharedCapture.h"
+#include <map>
+#include <mutex>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// frames a consumer without dropFrame may fall behind before it misses some
+#define SHARED_CAPTURE_QUEUE_DEPTH 4
+
+using namespace easyvideo;
+
+struct SharedSource
+{
+    std::string key;
+    std::string url;
+    std::string decoder;
+    std::vector<std::pair<int, double>> props;
+    int consumers = 0;      // under registry_mutex
+
+    std::mutex mtx;
+    StreamCapture cap;
+
+    // open when it is not, or reopen when decoding stopped (in-place reconnect gave up, end of
+    // stream). the other consumers stay subscribed and read on from the new session
+    bool ensureOpened()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (cap.isOpened() && cap.get(STREAM_RECV_ENDED) < 1)
+        {
+            return true;
+        }
+        return cap.reopen(url, decoder, props);
+    }
+
+    // each consumer has its own queue, a slow one misses frames instead of holding up the others
+    std::shared_ptr<FrameSubscriber> subscribe(bool dropFrame)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return cap.subscribe(dropFrame ? SUBSCRIBE_LATEST : SUBSCRIBE_EVERY, 0, SHARED_CAPTURE_QUEUE_DEPTH);
+    }
+
+    void set(int propId, double value)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        cap.set(propId, value);
+    }
+
+    double get(int propId)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return cap.get(propId);
+    }
+};
+
+static std::mutex registry_mutex;
+static std::map<std::string, std::shared_ptr<SharedSource>> registry;
+
+static std::string sourceKey(const std::string& url, const std::string& decoder,
+                             std::vector<std::pair<int, double>> props)
+{
+    // the order props were given in does not matter
+    std::sort(props.begin(), props.end());
+    std::ostringstream key;
+    // values differing past the 6th digit are different sources
+    key << std::setprecision(17) << url << "|" << decoder;
+    for (auto& prop: props)
+    {
+        key << "|" << prop.first << "=" << prop.second;
+    }
+    return key.str();
+}
+
+static std::shared_ptr<SharedSource> acquireSource(const std::string& url, const std::string& decoder,
+                                                   const std::vector<std::pair<int, double>>& props)
+{
+    std::string key = sourceKey(url, decoder, props);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto& src = registry[key];
+    if (src == nullptr)
+    {
+        src = std::make_shared<SharedSource>();
+        src->key = key;
+        src->url = url;
+        src->decoder = decoder;
+        src->props = props;
+    }
+    src->consumers++;
+    return src;
+}
+
+static void releaseSource(std::shared_ptr<SharedSource>& src)
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (--src->consumers <= 0)
+        {
+            registry.erase(src->key);
+        }
+    }
+    // the last reference closes the stream, outside the registry lock
+    src.reset();
+}
+
+
+struct SharedCapture::Impl
+{
+    std::shared_ptr<SharedSource> source;
+    std::shared_ptr<FrameSubscriber> subscriber;
+    std::string decoder = "auto";
+    std::vector<std::pair<int, double>> props;
+    bool dropFrame = false;
+    cv::Rect crop;
+};
+
+
+SharedCapture::SharedCapture(std::string url, std::string decoder,
+                             std::vector<std::pair<int, double>> props, bool dropFrame)
+{
+    open(url, decoder, props, dropFrame);
+}
+
+SharedCapture::~SharedCapture()
+{
+    release();
+    delete impl_;
+    impl_ = nullptr;
+}
+
+bool SharedCapture::open(std::string url, std::string decoder,
+                         std::vector<std::pair<int, double>> props, bool dropFrame)
+{
+    release();
+    if (impl_ == nullptr)
+    {
+        impl_ = new Impl();
+    }
+    impl_->decoder = decoder.empty() ? "auto" : decoder;
+    impl_->props = props;
+    impl_->dropFrame = dropFrame;
+
+    impl_->source = acquireSource(url, impl_->decoder, props);
+    if (!impl_->source->ensureOpened())
+    {
+        fprintf(stderr, "Cannot open shared stream.\n");
+        releaseSource(impl_->source);
+        return false;
+    }
+    impl_->subscriber = impl_->source->subscribe(dropFrame);
+    return true;
+}
+
+bool SharedCapture::open(std::string url, int apiPreference)
+{
+    if (impl_ == nullptr)
+    {
+        return open(url, std::string("auto"));
+    }
+    return open(url, impl_->decoder, impl_->props, impl_->dropFrame);
+}
+
+bool SharedCapture::read(cv::Mat &frame)
+{
+    Frame next;
+    if (!read(next))
+    {
+        return false;
+    }
+    frame = next.image;
+    return true;
+}
+
+bool SharedCapture::read(Frame &frame)
+{
+    if (!isOpened())
+    {
+        return false;
+    }
+    if (!impl_->subscriber->read(frame))
+    {
+        return false;
+    }
+    cv::Rect roi = impl_->crop & cv::Rect(0, 0, frame.image.cols, frame.image.rows);
+    if (roi.area() > 0)
+    {
+        frame.image = frame.image(roi);
+    }
+    return true;
+}
+
+bool SharedCapture::isOpened()
+{
+    return impl_ != nullptr && impl_->subscriber != nullptr;
+}
+
+void SharedCapture::release()
+{
+    if (impl_ == nullptr)
+    {
+        return;
+    }
+    impl_->subscriber.reset();
+    if (impl_->source != nullptr)
+    {
+        releaseSource(impl_->source);
+    }
+}
+
+void SharedCapture::operator >> (cv::Mat &frame)
+{
+    read(frame);
+}
+
+void SharedCapture::set(int propId, double value)
+{
+    if (isOpened())
+    {
+        impl_->source->set(propId, value);
+    }
+}
+
+double SharedCapture::get(int propId)
+{
+    if (!isOpened())
+    {
+        return -1;
+    }
+    if (impl_->crop.area() > 0 && propId == cv::CAP_PROP_FRAME_WIDTH)
+    {
+        return std::min((double)impl_->crop.width, impl_->source->get(propId) - impl_->crop.x);
+    }
+    if (impl_->crop.area() > 0 && propId == cv::CAP_PROP_FRAME_HEIGHT)
+    {
+        return std::min((double)impl_->crop.height, impl_->source->get(propId) - impl_->crop.y);
+    }
+    return impl_->source->get(propId);
+}
+
+void SharedCapture::setCrop(cv::Rect crop)
+{
+    if (impl_ == nullptr)
+    {
+        impl_ = new Impl();
+    }
+    impl_->crop = crop;
+}
+
+size_t SharedCapture::sources()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    return registry.size();
+}
+
+int SharedCapture::consumers(std::string url)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    int count = 0;
+    for (auto& src: registry)
+    {
+        if (src.second->url == url)
+        {
+            count += src.second->consumers;
+        }
+    }
+    return count;
+}
+
+#endif
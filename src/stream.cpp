@@ -2,6 +2,14 @@
 #define STREAM_CPP
 
 #include "easyvideo/opencv/stream.h"
+#include <mutex>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <sys/stat.h>
+#include <string.h>
 extern "C" {
 #include <libavcodec/avcodec.h>
 // #include <libavcodec/>
@@ -11,70 +19,709 @@ extern "C" {
 #include <libavutil/opt.h>
 #include <libavutil/avassert.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 }
 
+#define STREAM_AVIO_BUFFER_SIZE (64 * 1024)
+
+// packets given out by Stream::read(StreamPacket&), shared with the handles so
+// it can outlive the stream
+struct StreamPacketPool
+{
+    std::mutex mtx;
+    std::vector<AVPacket*> packets;
+    size_t max_size = 64;
+
+    AVPacket* get()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!packets.empty())
+            {
+                AVPacket* pkt = packets.back();
+                packets.pop_back();
+                return pkt;
+            }
+        }
+        return av_packet_alloc();
+    }
+
+    void put(AVPacket* pkt)
+    {
+        av_packet_unref(pkt);
+        std::lock_guard<std::mutex> lock(mtx);
+        if (packets.size() < max_size)
+        {
+            packets.push_back(pkt);
+            return;
+        }
+        av_packet_free(&pkt);
+    }
+
+    ~StreamPacketPool()
+    {
+        for (auto pkt: packets)
+        {
+            av_packet_free(&pkt);
+        }
+    }
+};
+
+// codec parameters of streams opened before, keyed by url, for StreamOpenOptions::fastOpen
+struct StreamInfoCache
+{
+    struct Entry
+    {
+        AVCodecParameters* codecpar = nullptr;
+        AVRational time_base = {0, 1};
+        AVRational avg_frame_rate = {0, 1};
+        int stream_index = -1;
+    };
+
+    std::mutex mtx;
+    std::map<std::string, Entry> entries;
+
+    static StreamInfoCache& instance()
+    {
+        static StreamInfoCache cache;
+        return cache;
+    }
+
+    void put(const std::string& url, AVStream* st)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        Entry& entry = entries[url];
+        if (entry.codecpar == nullptr)
+        {
+            entry.codecpar = avcodec_parameters_alloc();
+        }
+        avcodec_parameters_copy(entry.codecpar, st->codecpar);
+        entry.time_base = st->time_base;
+        entry.avg_frame_rate = st->avg_frame_rate;
+        entry.stream_index = st->index;
+    }
+
+    // fill the streams of a just opened input, false if url is unknown or the input differs
+    bool get(const std::string& url, AVFormatContext* ctx)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(url);
+        if (it == entries.end())
+        {
+            return false;
+        }
+        Entry& entry = it->second;
+        if (entry.stream_index < 0 || entry.stream_index >= (int)ctx->nb_streams)
+        {
+            return false;
+        }
+        AVStream* st = ctx->streams[entry.stream_index];
+        if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO ||
+            (st->codecpar->codec_id != AV_CODEC_ID_NONE && st->codecpar->codec_id != entry.codecpar->codec_id))
+        {
+            return false;
+        }
+        if (avcodec_parameters_copy(st->codecpar, entry.codecpar) < 0)
+        {
+            return false;
+        }
+        if (st->time_base.den == 0 || st->time_base.num == 0)
+        {
+            st->time_base = entry.time_base;
+        }
+        if (st->avg_frame_rate.num == 0)
+        {
+            st->avg_frame_rate = entry.avg_frame_rate;
+        }
+        return true;
+    }
+
+    void remove(const std::string& url)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (url.empty() || it->first == url)
+            {
+                avcodec_parameters_free(&it->second.codecpar);
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    ~StreamInfoCache()
+    {
+        remove("");
+    }
+};
+
+// keyframes of a file, with persistIndex saved next to it as <file>.kfidx so reopening does not scan again
+struct KeyFrameIndex
+{
+    struct Entry
+    {
+        int64_t pts, dts, pos;
+        int64_t frame;      // number of video packets before this one
+    };
+
+    std::vector<Entry> entries;
+    int64_t frames = 0;
+    bool built = false;
+
+    // the index is only valid for the same file size and modification time
+    static bool fileStat(const std::string& url, int64_t& size, int64_t& mtime)
+    {
+        struct stat st;
+        if (stat(url.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        size = st.st_size;
+        mtime = st.st_mtime;
+        return true;
+    }
+
+    bool load(const std::string& path, int64_t size, int64_t mtime, int stream_index)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp == nullptr)
+        {
+            return false;
+        }
+        char magic[4];
+        int32_t header[2];      // version, stream index
+        int64_t info[4];        // file size, mtime, frames, entries
+        bool ok = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "EVKI", 4) == 0 &&
+                  fread(header, sizeof(header), 1, fp) == 1 && header[0] == 1 && header[1] == stream_index &&
+                  fread(info, sizeof(info), 1, fp) == 1 && info[0] == size && info[1] == mtime && info[3] >= 0;
+        if (ok)
+        {
+            // a truncated or corrupt file must not size the vector
+            long pos = ftell(fp);
+            ok = pos >= 0 && fseek(fp, 0, SEEK_END) == 0;
+            long end = ok ? ftell(fp) : -1;
+            ok = ok && end >= pos && info[3] == (int64_t)((end - pos) / sizeof(Entry)) &&
+                 (end - pos) % sizeof(Entry) == 0 && fseek(fp, pos, SEEK_SET) == 0;
+        }
+        if (ok)
+        {
+            entries.resize(info[3]);
+            ok = entries.empty() || fread(entries.data(), sizeof(Entry), entries.size(), fp) == entries.size();
+            frames = info[2];
+        }
+        fclose(fp);
+        if (!ok)
+        {
+            entries.clear();
+            frames = 0;
+        }
+        return ok;
+    }
+
+    bool save(const std::string& path, int64_t size, int64_t mtime, int stream_index)
+    {
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (fp == nullptr)
+        {
+            return false;
+        }
+        int32_t header[2] = {1, stream_index};
+        int64_t info[4] = {size, mtime, frames, (int64_t)entries.size()};
+        bool ok = fwrite("EVKI", 1, 4, fp) == 4 &&
+                  fwrite(header, sizeof(header), 1, fp) == 1 &&
+                  fwrite(info, sizeof(info), 1, fp) == 1 &&
+                  (entries.empty() || fwrite(entries.data(), sizeof(Entry), entries.size(), fp) == entries.size());
+        fclose(fp);
+        if (!ok)
+        {
+            remove(path.c_str());
+        }
+        return ok;
+    }
+
+    // one pass over the video packets of a separate input, other streams are discarded
+    int scan(const std::string& url, int stream_index)
+    {
+        AVFormatContext* ctx = nullptr;
+        int ret = avformat_open_input(&ctx, url.c_str(), NULL, NULL);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        if (stream_index >= (int)ctx->nb_streams)
+        {
+            avformat_close_input(&ctx);
+            return AVERROR_INVALIDDATA;
+        }
+        for (unsigned i = 0; i < ctx->nb_streams; i++)
+        {
+            ctx->streams[i]->discard = (int)i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+        AVPacket* pkt = av_packet_alloc();
+        entries.clear();
+        frames = 0;
+        while ((ret = av_read_frame(ctx, pkt)) >= 0)
+        {
+            if (pkt->stream_index == stream_index)
+            {
+                int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                if ((pkt->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE)
+                {
+                    entries.push_back({pts, pkt->dts, pkt->pos, frames});
+                }
+                frames++;
+            }
+            av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+        avformat_close_input(&ctx);
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+};
+
 struct Stream::Impl
 {
-    bool isOpened = false;
+    std::atomic<bool> isOpened{false};
     int video_stream, ret;
 
     AVFormatContext *input_ctx = nullptr;
     AVStream *video = nullptr;
     AVPacket* packet = nullptr;
+    std::shared_ptr<StreamPacketPool> pool = std::make_shared<StreamPacketPool>();
 
     int step = 1;
+    bool eof = false;
 
+    // copies for the getters, set on open under info_mtx. another thread may be
+    // reopening the stream meanwhile, they never touch the format context
+    std::mutex info_mtx;
     int width=-1, height=-1, fps=-1, codec_id=-1;
+    double time_base=0;
+    int64_t start_time=0;
+    int64_t frames=-1;
+
+    StreamOpenOptions options;
+    std::string url;
+    KeyFrameIndex index;
+    int64_t seek_pts = AV_NOPTS_VALUE;  // packets before this keyframe are dropped after a seek
+    std::atomic<bool> interrupted{false};
+    int64_t deadline = 0;   // av_gettime_relative(), 0 for none
+
+    // custom io, see Stream::open(StreamReadCallback) and Stream::openMemory
+    AVIOContext* avio = nullptr;
+    StreamReadCallback read_cb;
+    std::atomic<easyvideo::ByteRing*> ring{nullptr};    // read_cb waits on it, interrupt() wakes it
+    const uint8_t* mem_data = nullptr;
+    size_t mem_size = 0, mem_pos = 0;
+
+    static int avioRead(void* opaque, uint8_t* buf, int size)
+    {
+        Impl* impl = static_cast<Impl*>(opaque);
+        if (impl->mem_data != nullptr)
+        {
+            size_t n = std::min((size_t)size, impl->mem_size - impl->mem_pos);
+            if (n == 0)
+            {
+                return AVERROR_EOF;
+            }
+            memcpy(buf, impl->mem_data + impl->mem_pos, n);
+            impl->mem_pos += n;
+            return (int)n;
+        }
+        while (true)
+        {
+            int ret = impl->read_cb(buf, size);
+            if (ret > 0)
+            {
+                return ret;
+            }
+            if (ret == 0)
+            {
+                return AVERROR_EOF;
+            }
+            if (ret != AVERROR(EAGAIN))
+            {
+                return ret;
+            }
+            // custom io is not covered by the interrupt callback of the format context
+            if (interruptCallback(impl))
+            {
+                return AVERROR_EXIT;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    static int64_t avioSeek(void* opaque, int64_t offset, int whence)
+    {
+        Impl* impl = static_cast<Impl*>(opaque);
+        int64_t pos;
+        switch (whence & ~AVSEEK_FORCE)
+        {
+        case AVSEEK_SIZE:
+            return impl->mem_size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = impl->mem_pos + offset;
+            break;
+        case SEEK_END:
+            pos = impl->mem_size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+        if (pos < 0 || pos > (int64_t)impl->mem_size)
+        {
+            return AVERROR(EINVAL);
+        }
+        impl->mem_pos = pos;
+        return pos;
+    }
+
+    int createIO(bool seekable)
+    {
+        uint8_t* buffer = (uint8_t*)av_malloc(STREAM_AVIO_BUFFER_SIZE);
+        if (buffer == nullptr)
+        {
+            return AVERROR(ENOMEM);
+        }
+        avio = avio_alloc_context(buffer, STREAM_AVIO_BUFFER_SIZE, 0, this, avioRead, nullptr, seekable ? avioSeek : nullptr);
+        if (avio == nullptr)
+        {
+            av_free(buffer);
+            return AVERROR(ENOMEM);
+        }
+        return 0;
+    }
+
+    void releaseIO()
+    {
+        if (avio != nullptr)
+        {
+            // the buffer may have been replaced by avio, free the current one
+            av_freep(&avio->buffer);
+            avio_context_free(&avio);
+        }
+        read_cb = nullptr;
+        ring = nullptr;
+        mem_data = nullptr;
+        mem_size = 0;
+        mem_pos = 0;
+    }
+
+    // AVIOInterruptCB, called by ffmpeg inside blocking io
+    static int interruptCallback(void* opaque)
+    {
+        Impl* impl = static_cast<Impl*>(opaque);
+        if (impl->interrupted)
+        {
+            return 1;
+        }
+        return impl->deadline > 0 && av_gettime_relative() > impl->deadline;
+    }
+
+    void setDeadline(int64_t timeout)
+    {
+        deadline = timeout > 0 ? av_gettime_relative() + timeout : 0;
+    }
+
+    bool reachedSeekTarget()
+    {
+        if (seek_pts == AV_NOPTS_VALUE)
+        {
+            return true;
+        }
+        int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if ((packet->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE && pts >= seek_pts)
+        {
+            seek_pts = AV_NOPTS_VALUE;
+            return true;
+        }
+        return false;
+    }
+
+    bool isFile()
+    {
+        return url.find("://") == std::string::npos || url.find("file:") == 0;
+    }
+
+    // lazily load or build the keyframe index of a file source
+    int buildIndex()
+    {
+        if (index.built)
+        {
+            return 0;
+        }
+        int64_t size = 0, mtime = 0;
+        std::string path = (url.find("file:") == 0 ? url.substr(5) : url);
+        if (!isFile() || !KeyFrameIndex::fileStat(path, size, mtime))
+        {
+            return AVERROR(ENOSYS);
+        }
+        std::string index_path = path + ".kfidx";
+        if (!(options.persistIndex && index.load(index_path, size, mtime, video_stream)))
+        {
+            int ret = index.scan(url, video_stream);
+            if (ret < 0)
+            {
+                fprintf(stderr, "Cannot build keyframe index of '%s'\n", url.c_str());
+                return ret;
+            }
+            if (options.persistIndex && !index.save(index_path, size, mtime, video_stream))
+            {
+                fprintf(stderr, "Cannot save keyframe index to '%s'\n", index_path.c_str());
+            }
+        }
+        index.built = true;
+        {
+            std::lock_guard<std::mutex> lock(info_mtx);
+            frames = index.frames;
+        }
+
+        // formats seeking by a generic index (e.g. mpegts, flv) would search the file otherwise
+        if (!(input_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+            avformat_index_get_entries_count(video) < (int)index.entries.size() / 2)
+        {
+            for (auto& e: index.entries)
+            {
+                if (e.pos >= 0 && e.dts != AV_NOPTS_VALUE)
+                {
+                    av_add_index_entry(video, e.pos, e.dts, 0, 0, AVINDEX_KEYFRAME);
+                }
+            }
+        }
+        return 0;
+    }
+
+    int seekTo(const KeyFrameIndex::Entry& e, int64_t& frame)
+    {
+        int64_t ts = (input_ctx->iformat->flags & AVFMT_SEEK_TO_PTS) || e.dts == AV_NOPTS_VALUE ? e.pts : e.dts;
+        int ret = av_seek_frame(input_ctx, video_stream, ts, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        eof = false;
+        seek_pts = e.pts;
+        frame = e.frame;
+        return 0;
+    }
+
+    // read the next packet of the video stream into packet, other streams are skipped
+    int readVideoPacket()
+    {
+        if (packet == nullptr)
+        {
+            packet = av_packet_alloc();
+        }
+        int ret = 0;
+        do
+        {
+            av_packet_unref(packet);
+            setDeadline(options.readTimeout);
+            ret = av_read_frame(input_ctx, packet);
+        } while (ret >= 0 && (packet->stream_index != video_stream || !reachedSeekTarget()));
+        deadline = 0;
+        if (ret == AVERROR_EXIT && !interrupted)
+        {
+            ret = AVERROR(ETIMEDOUT);
+        }
+        eof = ret == AVERROR_EOF;
+        return ret;
+    }
 };
 
 
 
 int Stream::open(std::string url)
 {
+    return open(url, StreamOpenOptions());
+}
+
+int Stream::open(std::string url, const StreamOpenOptions& opt)
+{
+    close();
     if (impl == nullptr)
     {
         impl = new Impl();
     }
+    return openInput(url, "", opt);
+}
+
+int Stream::open(StreamReadCallback read, std::string format, const StreamOpenOptions& opt)
+{
+    close();
+    if (impl == nullptr)
+    {
+        impl = new Impl();
+    }
+    if (!read || impl->createIO(false) < 0)
+    {
+        return -3;
+    }
+    impl->read_cb = read;
+    return openInput("", format, opt);
+}
+
+int Stream::open(easyvideo::ByteRing& ring, std::string format, const StreamOpenOptions& opt)
+{
+    close();
+    if (impl == nullptr)
+    {
+        impl = new Impl();
+    }
+    if (impl->createIO(false) < 0)
+    {
+        return -3;
+    }
+    Impl* stream = impl;
+    // blocks on the ring instead of returning EAGAIN, interrupt() and the deadlines end the wait
+    impl->read_cb = [&ring, stream](uint8_t* buf, int size) {
+        while (true)
+        {
+            bool closed = ring.closed();
+            int n = (int)ring.read(buf, size);
+            if (n > 0)
+            {
+                return n;
+            }
+            if (closed)
+            {
+                // everything written before close has been read
+                return AVERROR_EOF;
+            }
+            if (Impl::interruptCallback(stream))
+            {
+                return AVERROR_EXIT;
+            }
+            int64_t deadline = stream->deadline;
+            int timeout_ms = deadline > 0 ? (int)((deadline - av_gettime_relative()) / 1000 + 1) : -1;
+            ring.waitData([stream]() {return Impl::interruptCallback(stream) != 0;}, timeout_ms);
+        }
+    };
+    impl->ring = &ring;
+    return openInput("", format, opt);
+}
+
+int Stream::openMemory(const uint8_t* data, size_t size, std::string format, const StreamOpenOptions& opt)
+{
+    close();
+    if (impl == nullptr)
+    {
+        impl = new Impl();
+    }
+    if (data == nullptr || impl->createIO(true) < 0)
+    {
+        return -3;
+    }
+    impl->mem_data = data;
+    impl->mem_size = size;
+    return openInput("", format, opt);
+}
+
+int Stream::openInput(std::string url, std::string format, const StreamOpenOptions& opt)
+{
     impl->isOpened = false;
+    impl->eof = false;
+    impl->options = opt;
+    impl->url = url;
+    impl->index = KeyFrameIndex();
+    impl->seek_pts = AV_NOPTS_VALUE;
 
     AVDictionary* options = nullptr;
-    // av_dict_set(&options, "rtsp_transport", "tcp", 0);
-    av_dict_set(&options, "rtsp_transport", "udp", 0);
+    av_dict_set(&options, "rtsp_transport", opt.transport.empty() ? "udp" : opt.transport.c_str(), 0);
     av_dict_set_int(&options, "udp_buffer_size", 1024 * 1024, 0);
-    av_dict_set(&options, "stimeout", "2000000", 0);
+    if (opt.stimeout > 0)
+    {
+        av_dict_set_int(&options, "stimeout", opt.stimeout, 0);
+    }
+    if (opt.probesize > 0)
+    {
+        av_dict_set_int(&options, "probesize", opt.probesize, 0);
+    }
+    if (opt.analyzeduration > 0)
+    {
+        av_dict_set_int(&options, "analyzeduration", opt.analyzeduration, 0);
+    }
+    if (opt.fpsprobesize >= 0)
+    {
+        av_dict_set_int(&options, "fpsprobesize", opt.fpsprobesize, 0);
+    }
 
-    // int ret = avformat_open_input(&fmt_ctx, rtsp_url, nullptr, &options);
+    impl->input_ctx = avformat_alloc_context();
+    impl->input_ctx->interrupt_callback.callback = Impl::interruptCallback;
+    impl->input_ctx->interrupt_callback.opaque = impl;
+    impl->setDeadline(opt.openTimeout);
+    if (impl->avio != nullptr)
+    {
+        impl->input_ctx->pb = impl->avio;
+        impl->input_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    auto input_format = format.empty() ? nullptr : av_find_input_format(format.c_str());
+    if (!format.empty() && input_format == nullptr)
+    {
+        fprintf(stderr, "Unknown input format '%s'\n", format.c_str());
+    }
 
     /* open the input file */
-    if (avformat_open_input(&impl->input_ctx, url.c_str(), NULL, &options) != 0) {
+    int ret = avformat_open_input(&impl->input_ctx, url.c_str(), input_format, &options);
+    av_dict_free(&options);
+    if (ret != 0) {
+        impl->deadline = 0;
         fprintf(stderr, "Cannot open input source '%s'\n", url.c_str());
         return -3;
     }
 
-    if (avformat_find_stream_info(impl->input_ctx, NULL) < 0) {
+    // known stream, no need to probe
+    bool custom_io = impl->avio != nullptr;
+    bool cached = opt.fastOpen && !custom_io && StreamInfoCache::instance().get(url, impl->input_ctx);
+    ret = cached ? 0 : avformat_find_stream_info(impl->input_ctx, NULL);
+    impl->deadline = 0;
+    if (ret < 0) {
         fprintf(stderr, "Cannot find input stream information.\n");
         return -2;
     }
 
     /* find the video stream information */
-    int ret = av_find_best_stream(impl->input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    ret = av_find_best_stream(impl->input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
     if (ret < 0) {
         fprintf(stderr, "Cannot find a video stream in the input file\n");
         return -1;
     }
     impl->video_stream = ret;
     impl->video = impl->input_ctx->streams[impl->video_stream];
+    if (!cached && !custom_io && impl->video->codecpar->width > 0 && impl->video->codecpar->height > 0)
+    {
+        StreamInfoCache::instance().put(url, impl->video);
+    }
     // INFO << "video stream codec id: " << video->codecpar->codec_id << ENDL;
     
     // std::cout << "fps: " << impl->video->time_base.den << "," << impl->video->avg_frame_rate.num << std::endl;
-    impl->fps = impl->video->avg_frame_rate.num;
-    impl->width = impl->video->codecpar->width;
-    impl->height = impl->video->codecpar->height;
-    impl->codec_id = impl->video->codecpar->codec_id;
+    {
+        std::lock_guard<std::mutex> lock(impl->info_mtx);
+        impl->fps = impl->video->avg_frame_rate.num;
+        impl->width = impl->video->codecpar->width;
+        impl->height = impl->video->codecpar->height;
+        impl->codec_id = impl->video->codecpar->codec_id;
+        impl->time_base = av_q2d(impl->video->time_base);
+        impl->start_time = impl->video->start_time != AV_NOPTS_VALUE ? impl->video->start_time : 0;
+        impl->frames = impl->video->nb_frames > 0 ? impl->video->nb_frames : -1;
+    }
     impl->isOpened = true;
     return 0;
 }
 
+void Stream::clearStreamInfoCache(const std::string& url)
+{
+    StreamInfoCache::instance().remove(url);
+}
+
 void Stream::setStep(size_t step)
 {
     impl->step = step;
@@ -86,6 +733,7 @@ int Stream::width()
     {
         return -1;
     }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
     return impl->width;
 }
 
@@ -95,6 +743,7 @@ int Stream::height()
     {
         return -1;
     }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
     return impl->height;
 }
 
@@ -104,6 +753,7 @@ int Stream::fps()
     {
         return -1;
     }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
     return impl->fps;
 }
 
@@ -113,9 +763,99 @@ int Stream::codec_id()
     {
         return -1;
     }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
     return impl->codec_id;
 }
 
+double Stream::timeBase()
+{
+    if (impl == nullptr)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
+    return impl->time_base;
+}
+
+int Stream::seek(int64_t pts, int64_t& frame)
+{
+    if (impl == nullptr || !impl->isOpened)
+    {
+        return AVERROR(EINVAL);
+    }
+    int ret = impl->buildIndex();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    auto& entries = impl->index.entries;
+    if (entries.empty())
+    {
+        return AVERROR(ENOSYS);
+    }
+    auto it = std::upper_bound(entries.begin(), entries.end(), pts,
+        [](int64_t v, const KeyFrameIndex::Entry& e){ return v < e.pts; });
+    if (it != entries.begin())
+    {
+        --it;
+    }
+    return impl->seekTo(*it, frame);
+}
+
+int Stream::seekFrame(int64_t n, int64_t& frame)
+{
+    if (impl == nullptr || !impl->isOpened)
+    {
+        return AVERROR(EINVAL);
+    }
+    int ret = impl->buildIndex();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    auto& entries = impl->index.entries;
+    if (entries.empty())
+    {
+        return AVERROR(ENOSYS);
+    }
+    auto it = std::upper_bound(entries.begin(), entries.end(), n,
+        [](int64_t v, const KeyFrameIndex::Entry& e){ return v < e.frame; });
+    if (it != entries.begin())
+    {
+        --it;
+    }
+    return impl->seekTo(*it, frame);
+}
+
+int Stream::buildIndex()
+{
+    if (impl == nullptr || !impl->isOpened)
+    {
+        return AVERROR(EINVAL);
+    }
+    return impl->buildIndex();
+}
+
+int64_t Stream::startTime()
+{
+    if (impl == nullptr)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
+    return impl->start_time;
+}
+
+int64_t Stream::frameCount()
+{
+    if (impl == nullptr)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(impl->info_mtx);
+    return impl->frames;
+}
+
 int Stream::cur_dts()
 {
     if (impl == nullptr)
@@ -137,18 +877,10 @@ void* Stream::read(int& size)
         return nullptr;
     }
 
-    if (impl->packet != nullptr)
-    {
-        av_packet_unref(impl->packet);
-        av_packet_free(&impl->packet);
-        impl->packet = nullptr;
-    }
-    impl->packet = av_packet_alloc();
-    
     int ret = 0;
-    for (int i=0;i<impl->step;++i)
+    for (int i=0;i<impl->step && ret>=0;++i)
     {
-        ret = av_read_frame(impl->input_ctx, impl->packet);
+        ret = impl->readVideoPacket();
     }
     
     if (ret < 0)
@@ -171,15 +903,7 @@ void* Stream::read(int& size, int64_t& pts, int64_t& dts, bool& isKeyFrame)
         return nullptr;
     }
 
-    if (impl->packet != nullptr)
-    {
-        av_packet_unref(impl->packet);
-        av_packet_free(&impl->packet);
-        impl->packet = nullptr;
-    }
-    impl->packet = av_packet_alloc();
-    
-    int ret = av_read_frame(impl->input_ctx, impl->packet);
+    int ret = impl->readVideoPacket();
     if (ret < 0)
     {
         size = 0;
@@ -192,9 +916,83 @@ void* Stream::read(int& size, int64_t& pts, int64_t& dts, bool& isKeyFrame)
     return impl->packet->data;
 }
 
+int Stream::read(StreamPacket& packet)
+{
+    packet = StreamPacket();
+    if (impl == nullptr || !impl->isOpened)
+    {
+        return AVERROR(EINVAL);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    int ret = impl->readVideoPacket();
+    if (ret < 0)
+    {
+        return ret;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    packet.recvTime = std::chrono::duration<double>(t1.time_since_epoch()).count();
+    packet.demuxTime = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+    // hand the buffer over to a pooled packet, no copy of the data
+    auto pool = impl->pool;
+    AVPacket* pkt = pool->get();
+    if (pkt == nullptr)
+    {
+        return AVERROR(ENOMEM);
+    }
+    av_packet_move_ref(pkt, impl->packet);
+
+    packet.data = pkt->data;
+    packet.size = pkt->size;
+    packet.pts = pkt->pts;
+    packet.dts = pkt->dts;
+    packet.isKeyFrame = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+    packet.timeBase = impl->time_base;
+    packet.ref = std::shared_ptr<void>(pkt, [pool](void* p){ pool->put((AVPacket*)p); });
+    return 0;
+}
+
+bool Stream::eof()
+{
+    if (impl == nullptr)
+    {
+        return false;
+    }
+    return impl->eof;
+}
+
+void Stream::interrupt()
+{
+    if (impl != nullptr)
+    {
+        impl->interrupted = true;
+        easyvideo::ByteRing* ring = impl->ring;
+        if (ring != nullptr)
+        {
+            ring->wake();
+        }
+    }
+}
+
+void Stream::resume()
+{
+    if (impl != nullptr)
+    {
+        impl->interrupted = false;
+    }
+}
+
 void Stream::close()
 {
+    if (impl == nullptr)
+    {
+        return;
+    }
+    impl->isOpened = false;
     avformat_close_input(&impl->input_ctx);
+    // not closed by avformat_close_input with AVFMT_FLAG_CUSTOM_IO
+    impl->releaseIO();
     if (impl->packet != nullptr)
     {
         av_packet_unref(impl->packet);
@@ -4,6 +4,13 @@
 #include "easyvideo/opencv/streamCapture.h"
 #include "easyvideo/opencv/stream.h"
 #include "easyvideo/videoDecoder.h"
+#include "easyvideo/utils/spscRing.h"
+#include "easyvideo/utils/tripleBuffer.h"
+#include "easyvideo/utils/lagClock.h"
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <deque>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -16,13 +23,189 @@ extern "C" {
 }
 
 
-#define STREAM_CAP_FIRST_READ_TIMES 100
+#define STREAM_CAP_MAX_ERROR_PACKETS 100
 
 using namespace easyvideo;
 
+// decimate by frame time to one frame per interval seconds
+static bool selectByTime(double t, double interval, double& nextTime)
+{
+    if (nextTime < 0 || t < nextTime - 2 * interval)
+    {
+        // first frame, or pts jumped back
+        nextTime = t;
+    }
+    if (t + 1e-3 < nextTime)
+    {
+        return false;
+    }
+    nextTime += interval;
+    if (nextTime < t)
+    {
+        // pts jumped forward
+        nextTime = t + interval;
+    }
+    return true;
+}
+
+struct FrameSubscriber::Impl
+{
+    int policy = SUBSCRIBE_LATEST;
+    double value = 0;
+    size_t depth = 4;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::deque<Frame> queue;
+    bool closed = false;    // unsubscribed
+    bool ended = false;     // the capture stopped decoding
+    uint64_t received = 0;
+    uint64_t dropped = 0;
+
+    // receive thread only
+    uint64_t counter = 0;
+    uint64_t skipped = 0;   // by the policy since the last queued frame
+    double nextTime = -1;
+
+    // called by the receive thread with the time of the frame in seconds, false once unsubscribed
+    bool offer(const Frame& frame, double t)
+    {
+        if ((policy == SUBSCRIBE_NTH && value > 1 && counter++ % (uint64_t)value != 0) ||
+            (policy == SUBSCRIBE_MAX_FPS && value > 0 && !selectByTime(t, 1. / value, nextTime)))
+        {
+            skipped += 1 + frame.info.dropped;
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx);
+        if (closed || ended)
+        {
+            return !closed;
+        }
+        if (policy == SUBSCRIBE_EVERY && queue.size() >= depth)
+        {
+            // never wait for one subscriber, it misses the frames its queue has no room for
+            skipped += 1 + frame.info.dropped;
+            dropped++;
+            return true;
+        }
+        // info.dropped of a queued frame counts every source frame since the one before it
+        uint64_t missed = skipped;
+        skipped = 0;
+        if (policy == SUBSCRIBE_LATEST)
+        {
+            dropped += queue.size();
+            for (auto& old: queue)
+            {
+                missed += 1 + old.info.dropped;
+            }
+            queue.clear();
+        }
+        else if (queue.size() >= depth)
+        {
+            uint64_t lost = 1 + queue.front().info.dropped;
+            queue.pop_front();
+            dropped++;
+            if (queue.empty())
+            {
+                missed += lost;
+            }
+            else
+            {
+                queue.front().info.dropped += lost;
+            }
+        }
+        // shares the data, the receive thread decodes the next frame into another buffer
+        queue.push_back(frame);
+        queue.back().info.dropped += missed;
+        received++;
+        cond.notify_all();
+        return true;
+    }
+
+    void end()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ended = true;
+        cond.notify_all();
+    }
+
+    // attached to a reopened capture, before its receive thread starts
+    void restart()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ended = false;
+        counter = 0;
+        skipped = 0;
+        nextTime = -1;
+    }
+};
+
+FrameSubscriber::~FrameSubscriber()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    impl_->closed = true;
+    impl_->queue.clear();
+    impl_->cond.notify_all();
+}
+
+bool FrameSubscriber::read(cv::Mat &frame, int timeout_ms)
+{
+    Frame next;
+    if (!read(next, timeout_ms))
+    {
+        return false;
+    }
+    frame = next.image;
+    return true;
+}
+
+bool FrameSubscriber::read(Frame &frame, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(impl_->mtx);
+    auto ready = [this](){return !impl_->queue.empty() || impl_->ended;};
+    if (timeout_ms < 0)
+    {
+        impl_->cond.wait(lock, ready);
+    }
+    else if (!impl_->cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready))
+    {
+        return false;
+    }
+    if (impl_->queue.empty())
+    {
+        return false;
+    }
+    frame = impl_->queue.front();
+    impl_->queue.pop_front();
+    return true;
+}
+
+size_t FrameSubscriber::pending()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->queue.size();
+}
+
+uint64_t FrameSubscriber::received()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->received;
+}
+
+uint64_t FrameSubscriber::dropped()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->dropped;
+}
+
+
 struct StreamCaptureHandler
 {
     Stream stream;
+    StreamOpenOptions openOptions;
+    std::string url;
+    std::string decoderName;    // empty: open decoder by stream codec id
     // AVFormatContext *input_ctx = nullptr;
     // AVStream *video = nullptr;
     // AVPacket packet;
@@ -31,21 +214,315 @@ struct StreamCaptureHandler
     VideoDecoder* decoder=nullptr;
     bool no_decoder=false;
     bool isOpened = false;
-    int firstRead = STREAM_CAP_FIRST_READ_TIMES;
+    bool draining = false;
     int fps=-1;
     int recvMethod = STREAM_RECV_METHOD_BLOCK;
+    // in use by the decoding thread, set() changes requested and the decoding thread
+    // picks it up before its next packet, never in the middle of a decode
+    int outputFormat = VIDEO_FRAME_BGR;
+    cv::Size letterboxSize = cv::Size(0, 0);
+    int decodeMode = DECODE_MODE_ALL;
+    std::function<void(int, int)> formatChangeCallback;
+    struct DecoderOptions
+    {
+        int outputFormat = VIDEO_FRAME_BGR;
+        cv::Size letterboxSize = cv::Size(0, 0);
+        int decodeMode = DECODE_MODE_ALL;
+        std::function<void(int, int)> formatChangeCallback;
+    } requested;
+    std::mutex optionsMutex;
+    std::atomic<bool> optionsDirty{false};
+    int decoderThreads = -1;
+    int decoderThreadType = DECODER_THREAD_AUTO;
+    int step = 1;
+    double outputFps = 0;
+    double nextOutputTime = -1;
+    uint64_t decodedFrames = 0;
+
+    // demux thread: stream -> ring -> decoder
+    bool demuxThread = false;
+    int ringDepth = 64;
+    int ringPolicy = STREAM_RING_BLOCK;
+    SPSCRing<StreamPacket> ring;
+    std::thread demux_t;
+    std::atomic<bool> demuxEnded{false};
+    std::atomic<int> demuxRet{0};
+    std::atomic<uint64_t> droppedPackets{0};
+    StreamPacket lastPacket;        // keeps the data of readStream(streamData&) alive
+    std::atomic<bool> stopping{false};
+
+    // in-place reconnect of the demuxer, the decoder is kept
+    int reconnectTimes = 0;         // attempts per disconnection, -1 unlimited
+    int reconnectDelay = 100;       // ms, doubled after each failed attempt
+    int reconnectMaxDelay = 5000;   // ms
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<bool> decoderReset{false};
+    std::atomic<bool> decoderReopen{false};
+
+    // lag policy, see STREAM_MAX_LAG
+    double maxLag = 0;              // seconds
+    double lag = 0;                 // of the last packet
+    LagClock lagClock;              // lag from the wall clock when there is no demux thread
+    std::atomic<int64_t> latestPts{VIDEO_NOPTS_VALUE};    // newest packet read by the demux thread
+    bool lagSkipping = false;
+    uint64_t skippedGops = 0;
+    uint64_t skippedFrames = 0;
+
+    // position, and the target of the last seek the decoder has not reached yet
+    int64_t framePos = 0;
+    int64_t lastPts = VIDEO_NOPTS_VALUE;
+    int64_t seekPts = VIDEO_NOPTS_VALUE;
+    int64_t seekSkip = 0;
 
-    std::mutex imgProcessMutex1, imgProcessMutex2;
-    std::condition_variable imgProcessCond1, imgProcessCond2;
-    bool imgProcessing = false;
-    bool stopThread = false;
-    bool tempJudgeEqual = false;
-    uint64_t count_inner = 0;
-    uint64_t count_outer = 0;
+    // FrameInfo of the last frame read() decoded, stage times add up over the packets it took
+    FrameInfo info;
+    uint64_t frameId = 0;
+    uint64_t decimatedFrames = 0;   // skipped for outputFps
+    uint64_t droppedReported = 0;   // drops already counted in an info
+    double demuxMs = 0;
+    double decodeMs = 0;
+    double lastRecvTime = 0;
+    std::deque<std::pair<int64_t, double>> recvTimes;   // pts and receive time of recent packets
+
+    // drop mode: the receive thread decodes into a triple buffer, read() takes the newest frame
+    TripleBuffer<Frame> latest;
+    std::atomic<bool> stopThread{false};
+    uint64_t count_outer = 0;      // sequence of the frame read() returned last
+
+    // subscribe(), fed by the receive thread as well
+    std::mutex subscriberMutex;
+    std::vector<std::shared_ptr<FrameSubscriber::Impl>> subscribers;
 
     std::thread recv_t;
+    std::atomic<bool> recvRunning{false};  // recv_t started, read() takes the newest frame
+    // held by block mode while it decodes on the calling thread, subscribe() takes it before
+    // starting recv_t, so the two never decode at the same time
+    std::mutex readMutex;
+    // drop mode readers, not readMutex so subscribe() is not held up by a reader waiting for a frame
+    std::mutex frameMutex;
+
+    int openDecoder()
+    {
+        setDecoderOptions();
+        if (decoderName.empty())
+        {
+            return decoder->open_codec(stream.width(), stream.height(), stream.fps(), stream.codec_id());
+        }
+        return decoder->open_codec(stream.width(), stream.height(), stream.fps(), decoderName);
+    }
+
+    bool isNetwork()
+    {
+        return url.find("://") != std::string::npos && url.find("file:") != 0;
+    }
+
+    bool shouldReconnect(int r)
+    {
+        if (reconnectTimes == 0 || stopping)
+        {
+            return false;
+        }
+        // end of a local file is not a disconnection
+        return r != AVERROR_EOF || isNetwork();
+    }
+
+    // reopen the demuxer only, with exponential backoff and jitter
+    bool reconnect()
+    {
+        int codec = stream.codec_id();
+        std::mt19937 rng(std::random_device{}());
+        int delay = std::max(reconnectDelay, 1);
+        for (int i = 0; reconnectTimes < 0 || i < reconnectTimes; i++)
+        {
+            // wait a random time in [delay / 2, delay], cameras dropped together do not retry together
+            int wait = delay / 2 + (int)(rng() % (delay - delay / 2 + 1));
+            for (int t = 0; t < wait && !stopping; t += 10)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min(10, wait - t)));
+            }
+            if (stopping)
+            {
+                return false;
+            }
+            stream.close();
+            if (stream.open(url, openOptions) == 0)
+            {
+                // the reader flushes the decoder, or reopens it when the codec changed.
+                // a new size is picked up by the decoder from the frames
+                if (codec == stream.codec_id())
+                {
+                    decoderReset = true;
+                }
+                else
+                {
+                    decoderReopen = true;
+                }
+                reconnects++;
+                std::cout << "stream reconnected after " << i + 1 << " attempts: " << url << std::endl;
+                return true;
+            }
+            delay = std::min(delay * 2, std::max(reconnectMaxDelay, 1));
+        }
+        std::cerr << "failed to reconnect stream " << url << std::endl;
+        return false;
+    }
+
+    // read from the stream, reconnecting in place on errors. 0 or AVERROR
+    int readFromStream(StreamPacket& packet)
+    {
+        int r = stream.read(packet);
+        while (r < 0 && shouldReconnect(r) && reconnect())
+        {
+            r = stream.read(packet);
+        }
+        return r;
+    }
+
+    // called by the decoding thread before sending a packet of a reconnected stream
+    void resetDecoder()
+    {
+        if (decoder == nullptr)
+        {
+            return;
+        }
+        if (decoderReset || decoderReopen)
+        {
+            // timestamps start over
+            lagClock.reset();
+        }
+        if (decoderReopen.exchange(false))
+        {
+            decoderReset = false;
+            if (openDecoder() < 0)
+            {
+                std::cerr << "Cannot reopen video decoder." << std::endl;
+            }
+        }
+        else if (decoderReset.exchange(false))
+        {
+            decoder->flush();
+        }
+    }
+
+    void demuxLoop()
+    {
+        StreamPacket packet;
+        bool waitKeyFrame = false;
+        while (!stopping)
+        {
+            int r = readFromStream(packet);
+            if (r < 0)
+            {
+                demuxRet = r;
+                break;
+            }
+            if (packet.pts != VIDEO_NOPTS_VALUE)
+            {
+                latestPts = packet.pts;
+            }
+            if (waitKeyFrame && !packet.isKeyFrame)
+            {
+                droppedPackets++;
+                continue;
+            }
+            waitKeyFrame = false;
+            while (!ring.push(packet) && !stopping)
+            {
+                if (ringPolicy == STREAM_RING_DROP_GOP)
+                {
+                    // keep draining the socket. only this side drops: the rest of the incoming
+                    // gop goes, the queued packets stay decodable and the reader skips nothing
+                    droppedPackets++;
+                    waitKeyFrame = true;
+                    break;
+                }
+                ring.waitRoom([this]() {return stopping.load();});
+            }
+        }
+        demuxEnded = true;
+        ring.wake();
+    }
 
-    cv::Mat currentImg;
+    void startDemux()
+    {
+        if (!demuxThread)
+        {
+            return;
+        }
+        ring.reset(ringDepth > 0 ? ringDepth : 1);
+        stopping = false;
+        demuxEnded = false;
+        demuxRet = 0;
+        latestPts = VIDEO_NOPTS_VALUE;
+        demux_t = std::thread(&StreamCaptureHandler::demuxLoop, this);
+    }
+
+    void stopDemuxThread()
+    {
+        stopping = true;
+        ring.wake();
+        if (demux_t.joinable())
+        {
+            demux_t.join();
+        }
+        ring.reset(1);
+        lastPacket = StreamPacket();
+    }
+
+    // next demuxed packet, from the ring when the demux thread runs. 0 or AVERROR
+    int nextPacket(StreamPacket& packet)
+    {
+        if (!demuxThread)
+        {
+            return readFromStream(packet);
+        }
+        while (true)
+        {
+            bool ended = demuxEnded;
+            if (ring.pop(packet))
+            {
+                return 0;
+            }
+            if (ended)
+            {
+                packet = StreamPacket();
+                return demuxRet;
+            }
+            // woken by the next push, or when the demux thread ends
+            ring.waitItem([this]() {return demuxEnded.load();});
+        }
+    }
+
+    bool readStream(StreamPacket& packet)
+    {
+        if (!isOpened)
+        {
+            return false;
+        }
+        return nextPacket(packet) == 0;
+    }
+
+    // on the decoding thread, or before it starts
+    void setDecoderOptions()
+    {
+        {
+            std::lock_guard<std::mutex> lock(optionsMutex);
+            outputFormat = requested.outputFormat;
+            letterboxSize = requested.letterboxSize;
+            decodeMode = requested.decodeMode;
+            formatChangeCallback = requested.formatChangeCallback;
+            optionsDirty = false;
+        }
+        if (decoder == nullptr)
+        {
+            return;
+        }
+        decoder->setOutputFormat(outputFormat);
+        decoder->setLetterbox(letterboxSize);
+        decoder->setThreads(decoderThreads, decoderThreadType);
+        decoder->setDecodeMode(decodeMode);
+        decoder->setFormatChangeCallback(formatChangeCallback);
+    }
 
     bool readStream(streamData& sdata)
     {
@@ -53,7 +530,22 @@ struct StreamCaptureHandler
         {
             return false;
         }
-        sdata.data = stream.read(sdata.size, sdata.pts, sdata.dts, sdata.isKeyFrame);
+        if (demuxThread)
+        {
+            if (nextPacket(lastPacket) < 0)
+            {
+                return false;
+            }
+            sdata.data = lastPacket.data;
+            sdata.size = lastPacket.size;
+            sdata.pts = lastPacket.pts;
+            sdata.dts = lastPacket.dts;
+            sdata.isKeyFrame = lastPacket.isKeyFrame;
+        }
+        else
+        {
+            sdata.data = stream.read(sdata.size, sdata.pts, sdata.dts, sdata.isKeyFrame);
+        }
         if (sdata.data == nullptr || sdata.size <= 0)
         {
             return false;
@@ -61,79 +553,402 @@ struct StreamCaptureHandler
         return true;
     }
 
-    bool read(cv::Mat& img)
+    // seconds the packet is behind the newest one, 0 when unknown
+    double packetLag(const StreamPacket& packet)
+    {
+        if (packet.pts == VIDEO_NOPTS_VALUE || stream.timeBase() <= 0)
+        {
+            return 0;
+        }
+        if (demuxThread)
+        {
+            int64_t latest = latestPts;
+            return latest == VIDEO_NOPTS_VALUE ? 0 : (latest - packet.pts) * stream.timeBase();
+        }
+        // without a ring the backlog is in the socket, compare with the wall clock
+        double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        return lagClock.update(packet.pts * stream.timeBase(), now);
+    }
+
+    // next packet, dropping whole gops before decoding while the consumer lags. 0 or AVERROR
+    int nextLivePacket(StreamPacket& packet)
+    {
+        int r = nextPacket(packet);
+        if (r < 0 || !isNetwork())
+        {
+            return r;
+        }
+        lag = packetLag(packet);
+        if (maxLag <= 0)
+        {
+            return r;
+        }
+        while (true)
+        {
+            if (!lagSkipping)
+            {
+                if (lag <= maxLag)
+                {
+                    break;
+                }
+                lagSkipping = true;
+                skippedGops++;
+            }
+            else if (packet.isKeyFrame)
+            {
+                if (lag <= maxLag)
+                {
+                    // frames still queued in the decoder are as late as the dropped ones
+                    lagSkipping = false;
+                    decoder->flush();
+                    break;
+                }
+                skippedGops++;
+            }
+            skippedFrames++;
+            r = nextPacket(packet);
+            if (r < 0)
+            {
+                break;
+            }
+            lag = packetLag(packet);
+        }
+        return r;
+    }
+
+    // read the next packet to decode, honoring lag policy, step and decode mode. 0 or AVERROR
+    int readPacket(StreamPacket& packet)
+    {
+        int r = 0;
+        if (decodeMode == DECODE_MODE_KEYFRAME)
+        {
+            // inter frames can not be decoded without their references, never send them
+            do
+            {
+                r = nextLivePacket(packet);
+            } while (r == 0 && !packet.isKeyFrame);
+            return r;
+        }
+        for (int i = 0; i < step && r == 0; i++)
+        {
+            r = nextLivePacket(packet);
+        }
+        return r;
+    }
+
+    // decimate to outputFps by frame time, the frame index is used when pts is unknown
+    bool selectFrame(int64_t pts)
+    {
+        double t;
+        if (pts != VIDEO_NOPTS_VALUE && stream.timeBase() > 0)
+        {
+            t = pts * stream.timeBase();
+        }
+        else
+        {
+            t = decodedFrames / (double)(stream.fps() > 0 ? stream.fps() : 25);
+        }
+        decodedFrames++;
+        return selectByTime(t, 1. / outputFps, nextOutputTime);
+    }
+
+    // frames between the keyframe and the target of a seek are skipped
+    bool seeking(int64_t pts)
+    {
+        if (seekSkip > 0)
+        {
+            seekSkip--;
+            return true;
+        }
+        if (seekPts != VIDEO_NOPTS_VALUE && pts != VIDEO_NOPTS_VALUE && pts < seekPts)
+        {
+            return true;
+        }
+        seekPts = VIDEO_NOPTS_VALUE;
+        return false;
+    }
+
+    // seek to pts (stream time base), or to frame n when pts is VIDEO_NOPTS_VALUE
+    bool seek(int64_t pts, int64_t n)
     {
         if (!isOpened)
         {
             return false;
         }
-        int size = 0;
-        void* data = stream.read(size);
-        if (data == nullptr || size <= 0)
+        std::unique_lock<std::mutex> lock;
+        if (!blockRead(lock))
         {
+            std::cerr << "seek is not supported with STREAM_RECV_METHOD_DROP or subscribers" << std::endl;
             return false;
         }
-        ret = decoder->decodeFrame((uint8_t*)data, size, img);
-        bool success = ret == 0;
-        if (!success && firstRead)
+        bool restart = demux_t.joinable();
+        if (restart)
+        {
+            stopDemuxThread();
+        }
+        int64_t frame = 0;
+        int r = pts != VIDEO_NOPTS_VALUE ? stream.seek(pts, frame) : stream.seekFrame(n, frame);
+        if (r == 0)
+        {
+            if (decoder != nullptr)
+            {
+                decoder->flush();
+            }
+            draining = false;
+            nextOutputTime = -1;
+            framePos = frame;
+            seekPts = pts;
+            seekSkip = pts != VIDEO_NOPTS_VALUE ? 0 : n - frame;
+        }
+        else
+        {
+            std::cerr << "seek failed: " << r << std::endl;
+        }
+        if (restart)
+        {
+            startDemux();
+        }
+        return r == 0;
+    }
+
+    // the index adds entries to the format context being read, so the demux thread stops too
+    bool buildIndex()
+    {
+        if (!isOpened)
+        {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock;
+        if (!blockRead(lock))
+        {
+            std::cerr << "buildIndex is not supported with STREAM_RECV_METHOD_DROP or subscribers" << std::endl;
+            return false;
+        }
+        bool restart = demux_t.joinable();
+        if (restart)
+        {
+            stopDemuxThread();
+        }
+        int r = stream.buildIndex();
+        if (restart)
+        {
+            startDemux();
+        }
+        return r >= 0;
+    }
+
+    bool read(cv::Mat& img)
+    {
+        if (!isOpened || decoder == nullptr)
+        {
+            return false;
+        }
+        if (optionsDirty)
+        {
+            setDecoderOptions();
+        }
+        // feed packets until the decoder gives a frame, packets the decoder rejects
+        // (e.g. before the first keyframe) are skipped up to STREAM_CAP_MAX_ERROR_PACKETS times
+        int errorPackets = 0;
+        while (true)
+        {
+            int64_t pts = VIDEO_NOPTS_VALUE;
+            double t0 = steadySeconds();
+            ret = decoder->peekFrame(pts);
+            double t1 = steadySeconds();
+            decodeMs += (t1 - t0) * 1000.;
+            if (ret == DECODE_OK)
+            {
+                bool seek = seeking(pts);
+                if (seek || (outputFps > 0 && !selectFrame(pts)))
+                {
+                    // dropped before color conversion
+                    decoder->skipFrame();
+                    framePos++;
+                    decimatedFrames += seek ? 0 : 1;
+                    continue;
+                }
+            }
+            ret = decoder->receiveFrame(img);
+            if (ret == DECODE_OK)
+            {
+                framePos++;
+                lastPts = pts;
+                updateInfo(pts, (steadySeconds() - t1) * 1000.);
+                return true;
+            }
+            if (ret == DECODE_EOF)
+            {
+                return false;
+            }
+
+            StreamPacket packet;
+            int r = readPacket(packet);
+            if (r < 0 || packet.data == nullptr || packet.size <= 0)
+            {
+                if (r == AVERROR_EOF && !draining)
+                {
+                    // flush the frames still inside the decoder
+                    draining = true;
+                    decoder->sendPacket(nullptr, 0);
+                    continue;
+                }
+                return false;
+            }
+            resetDecoder();
+            demuxMs += packet.demuxTime;
+            lastRecvTime = packet.recvTime;
+            recvTimes.emplace_back(packet.pts, packet.recvTime);
+            if (recvTimes.size() > 32)
+            {
+                recvTimes.pop_front();
+            }
+            t0 = steadySeconds();
+            ret = decoder->sendPacket(packet.data, packet.size, packet.pts, packet.dts);
+            decodeMs += (steadySeconds() - t0) * 1000.;
+            if (ret < 0 && ++errorPackets >= STREAM_CAP_MAX_ERROR_PACKETS)
+            {
+                return false;
+            }
+        }
+    }
+
+    void updateInfo(int64_t pts, double convertMs)
+    {
+        info.pts = pts != VIDEO_NOPTS_VALUE && stream.timeBase() > 0 ? pts * stream.timeBase() : -1;
+        // decoders with frame delay give the frame of an earlier packet
+        info.recvTime = lastRecvTime;
+        for (auto it = recvTimes.rbegin(); it != recvTimes.rend(); ++it)
+        {
+            if (it->first == pts)
+            {
+                info.recvTime = it->second;
+                break;
+            }
+        }
+        info.demuxTime = demuxMs;
+        info.decodeTime = decodeMs;
+        info.convertTime = convertMs;
+        info.id = ++frameId;
+        uint64_t dropped = decimatedFrames + skippedFrames + droppedPackets;
+        info.dropped = dropped - droppedReported;
+        droppedReported = dropped;
+        demuxMs = 0;
+        decodeMs = 0;
+    }
+
+    void resetInfo()
+    {
+        info = FrameInfo();
+        frameId = 0;
+        decimatedFrames = 0;
+        droppedReported = skippedFrames + droppedPackets;
+        demuxMs = 0;
+        decodeMs = 0;
+        recvTimes.clear();
+    }
+
+    // waits for a frame newer than id, false once the receive thread ended and every frame is taken.
+    // the frame shares its data with the buffer, the receive thread does not write into it while shared.
+    // frames the caller missed are added to info.dropped. latest has a single reader side,
+    // threads reading at once take turns
+    bool getFrame(Frame& frame, uint64_t& id)
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        if (!latest.wait(id))
+        {
+            return false;
+        }
+        latest.fetch();
+        frame = latest.front();
+        if (latest.frontSeq() > id + 1)
+        {
+            frame.info.dropped += latest.frontSeq() - id - 1;
+        }
+        id = latest.frontSeq();
+        return true;
+    }
+
+    void recvThread()
+    {
+        while (isOpened && !stopThread)
+        {
+            Frame& frame = latest.back();
+            if (frame.image.u != nullptr && CV_XADD(&frame.image.u->refcount, 0) > 1)
+            {
+                // still held by a caller of read(), decode into a new buffer
+                frame.image.release();
+            }
+            if (!read(frame.image))
+            {
+                break;
+            }
+            frame.info = info;
+            dispatch(frame);
+            latest.publish();
+        }
+        latest.close();
+
+        std::lock_guard<std::mutex> lock(subscriberMutex);
+        for (auto& sub: subscribers)
+        {
+            sub->end();
+        }
+    }
+
+    // hand the frame to every subscriber, unsubscribed ones are removed
+    void dispatch(const Frame& frame)
+    {
+        std::vector<std::shared_ptr<FrameSubscriber::Impl>> subs;
+        {
+            std::lock_guard<std::mutex> lock(subscriberMutex);
+            if (subscribers.empty())
+            {
+                return;
+            }
+            subs = subscribers;
+        }
+        double t = frame.info.pts >= 0 ? frame.info.pts : framePos / (double)(stream.fps() > 0 ? stream.fps() : 25);
+        bool removed = false;
+        for (auto& sub: subs)
         {
-            firstRead--;
-            success = read(img);
+            removed |= !sub->offer(frame, t);
         }
-        if (firstRead)
+        if (removed)
         {
-            firstRead = false;
+            std::lock_guard<std::mutex> lock(subscriberMutex);
+            subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                [](const std::shared_ptr<FrameSubscriber::Impl>& sub){
+                    std::lock_guard<std::mutex> l(sub->mtx);
+                    return sub->closed;
+                }), subscribers.end());
         }
-        return success;
     }
 
-    bool getFrame(cv::Mat& frame, uint64_t& id)
+    // lock is held on true, decode on the calling thread then. false once recv_t decodes
+    bool blockRead(std::unique_lock<std::mutex>& lock)
     {
-        std::unique_lock<std::mutex> lock(imgProcessMutex1);
-        imgProcessCond2.wait(lock, [this, id](){return (!imgProcessing && (id != count_inner)) || stopThread;});
-        if (stopThread)
+        if (recvMethod == STREAM_RECV_METHOD_DROP || recvRunning)
         {
             return false;
         }
-        imgProcessing = true;
-        imgProcessCond1.notify_one();
-        frame = currentImg.clone();
-        id = count_inner;
-        imgProcessing = false;
-        imgProcessCond1.notify_one();
+        lock = std::unique_lock<std::mutex>(readMutex);
+        if (recvRunning)
+        {
+            // subscribe() started it meanwhile
+            lock.unlock();
+            return false;
+        }
         return true;
     }
 
-    void recvThread()
+    void startRecvThread()
     {
-        if (!isOpened)
-        {
-            return;
-        }
-
-        while (!stopThread)
+        if (!recv_t.joinable())
         {
-            // std::cout << "recvThread" << std::endl;
-            std::this_thread::sleep_for(std::chrono::milliseconds(3));
-            std::unique_lock<std::mutex> lock(imgProcessMutex2);
-            imgProcessCond1.wait(lock, [this](){return !imgProcessing || stopThread;});
-            if (stopThread)
-            {
-                return;
-            }
-            imgProcessing = true;
-            imgProcessCond2.notify_one();
-            bool success = read(currentImg);
-            imgProcessing = false;
-            if (success)
-            {
-                count_inner++;
-            }
-            imgProcessCond2.notify_one();
-            
-            
+            recvRunning = true;
+            recv_t = std::thread(&StreamCaptureHandler::recvThread, this);
         }
-
     }
 
 
@@ -177,8 +992,13 @@ bool StreamCapture::open(std::string url, std::string decoder_name)
     }
     auto impl = static_cast<StreamCaptureHandler*>(impl_);
     impl->isOpened = false;
+    impl->url = url;
+    impl->stopping = false;
+    // an explicit open, the only place a release() or failed open is forgotten.
+    // reconnect() reopens with the flag kept, so a stop is never lost
+    impl->stream.resume();
 
-    int ret = impl->stream.open(url);
+    int ret = impl->stream.open(url, impl->openOptions);
     if (ret < 0)
     {
         fprintf(stderr, "Cannot open stream.\n");
@@ -200,13 +1020,8 @@ bool StreamCapture::open(std::string url, std::string decoder_name)
         {
             impl->decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
         }
-
-        ret = impl->decoder->open_codec(
-            impl->stream.width(), 
-            impl->stream.height(),
-            impl->stream.fps(),
-            decoder_name
-        );
+        impl->decoderName = decoder_name;
+        ret = impl->openDecoder();
         if (ret < 0)
         {
             fprintf(stderr, "Cannot open video decoder.\n");
@@ -215,16 +1030,29 @@ bool StreamCapture::open(std::string url, std::string decoder_name)
     }
     
     impl->isOpened = true;
-    impl->firstRead = STREAM_CAP_FIRST_READ_TIMES;
+    impl->draining = false;
+    impl->nextOutputTime = -1;
+    impl->decodedFrames = 0;
+    impl->lagSkipping = false;
+    impl->lagClock.reset();
     impl->stopThread = false;
+    impl->latest.reset();
+    impl->count_outer = 0;
+    impl->resetInfo();
+    impl->startDemux();
     if (impl->recvMethod == STREAM_RECV_METHOD_DROP)
     {
         std::cout << "recvMethod: drop" << std::endl;
-        impl->recv_t = std::thread(&StreamCaptureHandler::recvThread, impl);
+        impl->startRecvThread();
     }
     else
     {
         std::cout << "recvMethod: block" << std::endl;
+        std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+        if (!impl->subscribers.empty())
+        {
+            impl->startRecvThread();
+        }
     }
     return true;
 }
@@ -243,8 +1071,13 @@ bool StreamCapture::open(std::string url, int apiPreference)
     }
     auto impl = static_cast<StreamCaptureHandler*>(impl_);
     impl->isOpened = false;
+    impl->url = url;
+    impl->stopping = false;
+    // an explicit open, the only place a release() or failed open is forgotten.
+    // reconnect() reopens with the flag kept, so a stop is never lost
+    impl->stream.resume();
 
-    int ret = impl->stream.open(url);
+    int ret = impl->stream.open(url, impl->openOptions);
     if (ret < 0)
     {
         fprintf(stderr, "Cannot open stream.\n");
@@ -256,28 +1089,37 @@ bool StreamCapture::open(std::string url, int apiPreference)
 #else
     impl->decoder = getVideoDecoder(CODEC_PLATFORM_FFMPEG);
 #endif
-    ret = impl->decoder->open_codec(
-        impl->stream.width(), 
-        impl->stream.height(),
-        impl->stream.fps(),
-        impl->stream.codec_id()
-    );
+    impl->decoderName = "";
+    ret = impl->openDecoder();
     if (ret < 0)
     {
         fprintf(stderr, "Cannot open video decoder.\n");
         return false;
     }
     impl->isOpened = true;
-    impl->firstRead = STREAM_CAP_FIRST_READ_TIMES;
+    impl->draining = false;
+    impl->nextOutputTime = -1;
+    impl->decodedFrames = 0;
+    impl->lagSkipping = false;
+    impl->lagClock.reset();
     impl->stopThread = false;
+    impl->latest.reset();
+    impl->count_outer = 0;
+    impl->resetInfo();
+    impl->startDemux();
     if (impl->recvMethod == STREAM_RECV_METHOD_DROP)
     {
         std::cout << "recvMethod: drop" << std::endl;
-        impl->recv_t = std::thread(&StreamCaptureHandler::recvThread, impl);
+        impl->startRecvThread();
     }
     else
     {
         std::cout << "recvMethod: block" << std::endl;
+        std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+        if (!impl->subscribers.empty())
+        {
+            impl->startRecvThread();
+        }
     }
     return true;
 }
@@ -299,14 +1141,84 @@ bool StreamCapture::read(cv::Mat &frame)
         std::cerr << "decoder not init!" << std::endl;
     }
 
-    if (impl->recvMethod == STREAM_RECV_METHOD_DROP)
+    std::unique_lock<std::mutex> lock;
+    if (impl->blockRead(lock))
     {
-        return impl->getFrame(frame, impl->count_outer);
+        // a new buffer per frame, frames the caller kept from earlier reads stay intact.
+        // readInto() decodes into the caller's buffer instead
+        frame.release();
+        return impl->read(frame);
     }
-    else
+    Frame latest;
+    if (!impl->getFrame(latest, impl->count_outer))
+    {
+        return false;
+    }
+    frame = latest.image;
+    return true;
+}
+
+
+bool StreamCapture::readInto(cv::Mat &frame)
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    if (!impl->isOpened)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock;
+    if (impl->blockRead(lock))
     {
+        // the decoders write yuv and rga output as packed rows
+        if (!frame.isContinuous())
+        {
+            frame.release();
+        }
         return impl->read(frame);
     }
+    Frame latest;
+    if (!impl->getFrame(latest, impl->count_outer))
+    {
+        return false;
+    }
+    if (!frame.isContinuous())
+    {
+        frame.release();
+    }
+    latest.image.copyTo(frame);
+    return true;
+}
+
+
+bool StreamCapture::read(Frame &frame)
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    if (!impl->isOpened)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock;
+    if (!impl->blockRead(lock))
+    {
+        return impl->getFrame(frame, impl->count_outer);
+    }
+    frame.image.release();
+    if (!impl->read(frame.image))
+    {
+        return false;
+    }
+    frame.info = impl->info;
+    return true;
 }
 
 
@@ -325,6 +1237,146 @@ bool StreamCapture::readStream(streamData& data)
 }
 
 
+bool StreamCapture::readStream(StreamPacket& packet)
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    return impl->readStream(packet);
+}
+
+
+bool StreamCapture::seek(double seconds)
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    if (impl->stream.timeBase() <= 0)
+    {
+        return false;
+    }
+    int64_t pts = impl->stream.startTime() + (int64_t)(seconds / impl->stream.timeBase() + 0.5);
+    return impl->seek(pts, 0);
+}
+
+
+bool StreamCapture::seekFrame(int64_t n)
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    return impl->seek(VIDEO_NOPTS_VALUE, n < 0 ? 0 : n);
+}
+
+
+bool StreamCapture::buildIndex()
+{
+    if (impl_ == nullptr)
+    {
+        return false;
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    return impl->buildIndex();
+}
+
+
+void StreamCapture::setFormatChangeCallback(std::function<void(int width, int height)> callback)
+{
+    if (impl_ == nullptr)
+    {
+        impl_ = new StreamCaptureHandler();
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    std::lock_guard<std::mutex> lock(impl->optionsMutex);
+    impl->requested.formatChangeCallback = callback;
+    impl->optionsDirty = true;
+}
+
+
+std::shared_ptr<FrameSubscriber> StreamCapture::subscribe(int policy, double value, int queue_depth)
+{
+    if (impl_ == nullptr)
+    {
+        impl_ = new StreamCaptureHandler();
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    auto sub = std::make_shared<FrameSubscriber::Impl>();
+    sub->policy = policy;
+    sub->value = value;
+    sub->depth = queue_depth > 0 ? queue_depth : 1;
+
+    // waits for a block mode read() on another thread to return its frame
+    std::lock_guard<std::mutex> readLock(impl->readMutex);
+    std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+    impl->subscribers.push_back(sub);
+    if (impl->isOpened)
+    {
+        impl->startRecvThread();
+    }
+    if (impl->latest.closed())
+    {
+        // the receive thread already ended
+        sub->end();
+    }
+    return std::make_shared<FrameSubscriber>(sub);
+}
+
+
+bool StreamCapture::reopen(std::string url, std::string decoder_name, std::vector<std::pair<int, double>> props)
+{
+    // taken out first, release() would end them
+    std::vector<std::shared_ptr<FrameSubscriber::Impl>> subscribers;
+    if (impl_ != nullptr)
+    {
+        auto impl = static_cast<StreamCaptureHandler*>(impl_);
+        std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+        subscribers.swap(impl->subscribers);
+    }
+    release();
+    for (auto& prop: props)
+    {
+        set(prop.first, prop.second);
+    }
+    bool ok = decoder_name == "auto" ? open(url, cv::CAP_ANY) : open(url, decoder_name);
+    if (subscribers.empty())
+    {
+        return ok;
+    }
+
+    if (impl_ == nullptr)
+    {
+        impl_ = new StreamCaptureHandler();
+    }
+    auto impl = static_cast<StreamCaptureHandler*>(impl_);
+    std::lock_guard<std::mutex> readLock(impl->readMutex);
+    std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+    for (auto& sub: subscribers)
+    {
+        sub->restart();
+        impl->subscribers.push_back(sub);
+    }
+    if (ok)
+    {
+        impl->startRecvThread();
+    }
+    else
+    {
+        // nothing feeds them until the next reopen
+        for (auto& sub: subscribers)
+        {
+            sub->end();
+        }
+    }
+    return ok;
+}
+
+
 bool StreamCapture::isOpened()
 {
     if (impl_ == nullptr)
@@ -346,7 +1398,15 @@ void StreamCapture::set(int propId, double value)
         impl_ = new StreamCaptureHandler();
     }
     auto impl = static_cast<StreamCaptureHandler*>(impl_);
-    if (propId == STREAM_RECV_METHOD)
+    if (propId == cv::CAP_PROP_POS_FRAMES)
+    {
+        seekFrame((int64_t)value);
+    }
+    else if (propId == cv::CAP_PROP_POS_MSEC)
+    {
+        seek(value / 1000.);
+    }
+    else if (propId == STREAM_RECV_METHOD)
     {
         impl->recvMethod = (int)value;
         // std::cout << "recvMethod: " << value << std::endl;
@@ -354,6 +1414,110 @@ void StreamCapture::set(int propId, double value)
     else if (propId == STREAM_RECV_STEP)
     {
         impl->stream.setStep((size_t)value);
+        impl->step = value > 1 ? (int)value : 1;
+    }
+    else if (propId == STREAM_OUTPUT_FORMAT)
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        impl->requested.outputFormat = (int)value;
+        impl->optionsDirty = true;
+    }
+    else if (propId == STREAM_LETTERBOX_WIDTH)
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        impl->requested.letterboxSize.width = (int)value;
+        impl->optionsDirty = true;
+    }
+    else if (propId == STREAM_LETTERBOX_HEIGHT)
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        impl->requested.letterboxSize.height = (int)value;
+        impl->optionsDirty = true;
+    }
+    else if (propId == STREAM_OUTPUT_FPS)
+    {
+        impl->outputFps = value;
+        impl->nextOutputTime = -1;
+    }
+    else if (propId == STREAM_DECODE_MODE)
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        impl->requested.decodeMode = (int)value;
+        impl->optionsDirty = true;
+    }
+    else if (propId == STREAM_DECODER_THREADS)
+    {
+        // takes effect on next open
+        impl->decoderThreads = (int)value;
+    }
+    else if (propId == STREAM_DECODER_THREAD_TYPE)
+    {
+        impl->decoderThreadType = (int)value;
+    }
+    else if (propId == STREAM_RTSP_TRANSPORT)
+    {
+        impl->openOptions.transport = value > 0 ? "tcp" : "udp";
+    }
+    else if (propId == STREAM_PROBESIZE)
+    {
+        impl->openOptions.probesize = (int64_t)value;
+    }
+    else if (propId == STREAM_ANALYZEDURATION)
+    {
+        impl->openOptions.analyzeduration = (int64_t)value;
+    }
+    else if (propId == STREAM_FPS_PROBESIZE)
+    {
+        impl->openOptions.fpsprobesize = (int)value;
+    }
+    else if (propId == STREAM_TIMEOUT)
+    {
+        impl->openOptions.stimeout = (int64_t)value;
+    }
+    else if (propId == STREAM_FAST_OPEN)
+    {
+        impl->openOptions.fastOpen = value > 0;
+    }
+    else if (propId == STREAM_PERSIST_INDEX)
+    {
+        impl->openOptions.persistIndex = value > 0;
+    }
+    else if (propId == STREAM_OPEN_TIMEOUT)
+    {
+        impl->openOptions.openTimeout = (int64_t)value;
+    }
+    else if (propId == STREAM_READ_TIMEOUT)
+    {
+        impl->openOptions.readTimeout = (int64_t)value;
+    }
+    else if (propId == STREAM_RECONNECT)
+    {
+        impl->reconnectTimes = (int)value;
+    }
+    else if (propId == STREAM_RECONNECT_DELAY)
+    {
+        impl->reconnectDelay = (int)value;
+    }
+    else if (propId == STREAM_RECONNECT_MAX_DELAY)
+    {
+        impl->reconnectMaxDelay = (int)value;
+    }
+    else if (propId == STREAM_MAX_LAG)
+    {
+        impl->maxLag = value / 1000.;
+    }
+    else if (propId == STREAM_DEMUX_THREAD)
+    {
+        // takes effect on next open
+        impl->demuxThread = value > 0;
+    }
+    else if (propId == STREAM_RING_DEPTH)
+    {
+        impl->ringDepth = (int)value;
+    }
+    else if (propId == STREAM_RING_POLICY)
+    {
+        impl->ringPolicy = (int)value;
     }
 }
 
@@ -370,13 +1534,132 @@ double StreamCapture::get(int propId)
         return impl->fps;
         break;
     case cv::CAP_PROP_FRAME_WIDTH:
+        if (impl->decoder != nullptr && impl->decoder->frame_width_ > 0)
+        {
+            return impl->decoder->frame_width_;
+        }
         return impl->stream.width();
         break;
     case cv::CAP_PROP_FRAME_HEIGHT:
+        if (impl->decoder != nullptr && impl->decoder->frame_height_ > 0)
+        {
+            return impl->decoder->frame_height_;
+        }
         return impl->stream.height();
         break;
     case cv::CAP_PROP_POS_FRAMES:
-        return impl->stream.cur_dts();
+        return impl->framePos;
+        break;
+    case cv::CAP_PROP_POS_MSEC:
+        if (impl->lastPts == VIDEO_NOPTS_VALUE)
+        {
+            return 0;
+        }
+        return (impl->lastPts - impl->stream.startTime()) * impl->stream.timeBase() * 1000.;
+        break;
+    case cv::CAP_PROP_FRAME_COUNT:
+        return impl->stream.frameCount();
+        break;
+    case STREAM_OUTPUT_FORMAT:
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        return impl->requested.outputFormat;
+    }
+    case STREAM_LETTERBOX_WIDTH:
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        return impl->requested.letterboxSize.width;
+    }
+    case STREAM_LETTERBOX_HEIGHT:
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        return impl->requested.letterboxSize.height;
+    }
+    case STREAM_OUTPUT_FPS:
+        return impl->outputFps;
+        break;
+    case STREAM_DECODE_MODE:
+    {
+        std::lock_guard<std::mutex> lock(impl->optionsMutex);
+        return impl->requested.decodeMode;
+    }
+    case STREAM_DECODER_THREADS:
+        return impl->decoderThreads;
+        break;
+    case STREAM_DECODER_THREAD_TYPE:
+        return impl->decoderThreadType;
+        break;
+    case STREAM_RTSP_TRANSPORT:
+        return impl->openOptions.transport == "tcp" ? 1 : 0;
+        break;
+    case STREAM_PROBESIZE:
+        return impl->openOptions.probesize;
+        break;
+    case STREAM_ANALYZEDURATION:
+        return impl->openOptions.analyzeduration;
+        break;
+    case STREAM_FPS_PROBESIZE:
+        return impl->openOptions.fpsprobesize;
+        break;
+    case STREAM_TIMEOUT:
+        return impl->openOptions.stimeout;
+        break;
+    case STREAM_FAST_OPEN:
+        return impl->openOptions.fastOpen;
+        break;
+    case STREAM_PERSIST_INDEX:
+        return impl->openOptions.persistIndex;
+        break;
+    case STREAM_OPEN_TIMEOUT:
+        return impl->openOptions.openTimeout;
+        break;
+    case STREAM_READ_TIMEOUT:
+        return impl->openOptions.readTimeout;
+        break;
+    case STREAM_RECONNECT:
+        return impl->reconnectTimes;
+        break;
+    case STREAM_RECONNECT_DELAY:
+        return impl->reconnectDelay;
+        break;
+    case STREAM_RECONNECT_MAX_DELAY:
+        return impl->reconnectMaxDelay;
+        break;
+    case STREAM_RECONNECT_COUNT:
+        return impl->reconnects;
+        break;
+    case STREAM_MAX_LAG:
+        return impl->maxLag * 1000.;
+        break;
+    case STREAM_LAG_SKIPPED_GOPS:
+        return impl->skippedGops;
+        break;
+    case STREAM_LAG_SKIPPED_FRAMES:
+        return impl->skippedFrames;
+        break;
+    case STREAM_LAG:
+        return impl->lag * 1000.;
+        break;
+    case STREAM_RECV_ENDED:
+        return impl->recvRunning && impl->latest.closed();
+        break;
+    case STREAM_DEMUX_THREAD:
+        return impl->demuxThread;
+        break;
+    case STREAM_RING_DEPTH:
+        return impl->ringDepth;
+        break;
+    case STREAM_RING_POLICY:
+        return impl->ringPolicy;
+        break;
+    case STREAM_RING_SIZE:
+        return impl->demuxThread ? impl->ring.size() : 0;
+        break;
+    case STREAM_RING_DROPPED:
+        return impl->droppedPackets;
+        break;
+    case STREAM_LETTERBOX_RATIO:
+        return impl->decoder == nullptr ? 1. : impl->decoder->getLetterboxRatio();
         break;
     default:
         break;
@@ -392,11 +1675,24 @@ void StreamCapture::release()
     }
     auto impl = static_cast<StreamCaptureHandler*>(impl_);
 
+    // the drop mode thread may be waiting on the ring and the demux thread blocked in
+    // io or reconnecting, stop all before joining
+    impl->stopThread = true;
+    impl->stopping = true;
+    impl->stream.interrupt();
+    {
+        // wake subscribers waiting in read()
+        std::lock_guard<std::mutex> lock(impl->subscriberMutex);
+        for (auto& sub: impl->subscribers)
+        {
+            sub->end();
+        }
+    }
     if (impl->recv_t.joinable())
     {
-        impl->stopThread = true;
         impl->recv_t.join();
     }
+    impl->stopDemuxThread();
 
     impl->stream.close();
     if (impl->decoder != nullptr)
@@ -0,0 +1,576 @@
+#ifndef STREAM_GROUP_CPP
+#define STREAM_GROUP_CPP
+
+#include "easyvideo/streamGroup.h"
+#include "easyvideo/videoDecoder.h"
+#include "easyvideo/utils/spscRing.h"
+#include <map>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// packets decoded per turn, then the worker moves on to the next stream
+#define STREAM_GROUP_PACKETS_PER_TURN 8
+// packets queued between the reader of a stream and the decoding workers
+#define STREAM_GROUP_QUEUE_DEPTH 64
+#define STREAM_GROUP_REOPEN_MIN_MS 100
+#define STREAM_GROUP_REOPEN_MAX_MS 5000
+
+using namespace easyvideo;
+
+enum GroupPacketType
+{
+    GROUP_PACKET,
+    GROUP_OPENED,   // the stream was (re)opened, codec parameters follow
+    GROUP_END       // end of a file, drain the decoder
+};
+
+struct GroupPacket
+{
+    int type = GROUP_PACKET;
+    StreamPacket packet;
+    int codec = -1, width = -1, height = -1, fps = -1;
+};
+
+struct GroupSource
+{
+    int id = -1;
+    std::string url;
+    std::string decoderName;
+    StreamOpenOptions options;
+    StreamGroup::FrameCallback callback;
+    int outputFormat = VIDEO_FRAME_BGR;
+    // puts the source on the queue of the workers, called by the reader
+    std::function<void()> ready;
+
+    // reader side, owned by the reader thread while it runs
+    Stream stream;
+    std::thread reader;
+    bool opened = false;
+    bool atEnd = false;
+    int reopenDelay = 0;
+    bool waitKeyFrame = false;
+    bool hasPending = false;
+    GroupPacket pending;    // not queued yet when the reader was stopped
+
+    SPSCRing<GroupPacket> queue{STREAM_GROUP_QUEUE_DEPTH};
+    std::atomic<bool> queued{false};    // waiting for or handled by a worker
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> removed{false};
+
+    // decoding side, one worker at a time
+    VideoDecoder* decoder = nullptr;
+    int codec = -1;
+    bool decoderOpened = false;
+    uint64_t decodeErrors = 0;
+    std::atomic<bool> finished{false};
+    std::atomic<int64_t> frames{0};
+
+    ~GroupSource()
+    {
+        stopReader(true);
+        stream.close();
+        if (decoder != nullptr)
+        {
+            delete decoder;
+            decoder = nullptr;
+        }
+    }
+
+    bool isFile()
+    {
+        return url.find("://") == std::string::npos || url.find("file:") == 0;
+    }
+
+    void startReader()
+    {
+        // a file at its end only has the end marker left to queue
+        if (reader.joinable() || (atEnd && !hasPending))
+        {
+            return;
+        }
+        stopping = false;
+        stream.resume();
+        reader = std::thread(&GroupSource::readLoop, this);
+    }
+
+    /**
+     * a file is left open and continues where it stopped. an interrupted read of a live
+     * stream cannot be resumed, it is closed and reopened by the next startReader
+     */
+    void stopReader(bool interrupt)
+    {
+        stopping = true;
+        if (interrupt)
+        {
+            stream.interrupt();
+        }
+        queue.wake();
+        if (reader.joinable())
+        {
+            reader.join();
+        }
+    }
+
+    int backoff()
+    {
+        reopenDelay = std::min(std::max(reopenDelay * 2, STREAM_GROUP_REOPEN_MIN_MS), STREAM_GROUP_REOPEN_MAX_MS);
+        return reopenDelay;
+    }
+
+    void pause(int ms)
+    {
+        for (int t = 0; t < ms && !stopping; t += 10)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::min(10, ms - t)));
+        }
+    }
+
+    // false when stopped before it was queued. a full queue drops packets of live
+    // streams up to the next keyframe rather than fall behind the camera, files wait
+    bool push(GroupPacket& p)
+    {
+        if (p.type == GROUP_PACKET)
+        {
+            if (waitKeyFrame && !p.packet.isKeyFrame)
+            {
+                return true;
+            }
+            waitKeyFrame = false;
+        }
+        while (!queue.push(p))
+        {
+            if (stopping)
+            {
+                return false;
+            }
+            if (p.type == GROUP_PACKET && !isFile())
+            {
+                waitKeyFrame = true;
+                return true;
+            }
+            queue.waitRoom([this]() {return stopping.load();});
+        }
+        ready();
+        return true;
+    }
+
+    // blocking reads on a thread of its own, the workers only decode
+    void readLoop()
+    {
+        if (hasPending)
+        {
+            hasPending = false;
+            if (!push(pending))
+            {
+                hasPending = true;
+                return;
+            }
+            if (atEnd)
+            {
+                return;
+            }
+        }
+        while (!stopping)
+        {
+            GroupPacket p;
+            if (!opened)
+            {
+                if (stream.open(url, options) < 0)
+                {
+                    stream.close();
+                    int delay = backoff();
+                    if (!stopping)
+                    {
+                        std::cerr << "StreamGroup: cannot open " << url << ", retry in " << delay << " ms" << std::endl;
+                    }
+                    pause(delay);
+                    continue;
+                }
+                opened = true;
+                reopenDelay = 0;
+                waitKeyFrame = false;
+                p.type = GROUP_OPENED;
+                p.codec = stream.codec_id();
+                p.width = stream.width();
+                p.height = stream.height();
+                p.fps = stream.fps();
+            }
+            else
+            {
+                int ret = stream.read(p.packet);
+                if (ret < 0)
+                {
+                    if (stopping)
+                    {
+                        break;
+                    }
+                    if (ret == AVERROR_EOF && isFile())
+                    {
+                        // the end, not a disconnection
+                        atEnd = true;
+                        p.type = GROUP_END;
+                    }
+                    else
+                    {
+                        int delay = backoff();
+                        std::cerr << "StreamGroup: " << url << " disconnected (" << ret << "), reopen in " << delay << " ms" << std::endl;
+                        stream.close();
+                        opened = false;
+                        pause(delay);
+                        continue;
+                    }
+                }
+            }
+            if (!push(p))
+            {
+                pending = std::move(p);
+                hasPending = true;
+                break;
+            }
+            if (atEnd)
+            {
+                break;
+            }
+        }
+        if (opened && (atEnd || !isFile()))
+        {
+            stream.close();
+            opened = false;
+        }
+    }
+
+    // a new buffer per frame, the callback may keep it
+    void deliver()
+    {
+        while (true)
+        {
+            cv::Mat frame;
+            if (decoder->receiveFrame(frame) != DECODE_OK)
+            {
+                break;
+            }
+            frames++;
+            if (callback)
+            {
+                callback(id, frame);
+            }
+        }
+    }
+
+    void openDecoder(const GroupPacket& p)
+    {
+        // a new size after reconnecting is picked up by the decoder from the frames
+        if (decoderOpened && codec == p.codec)
+        {
+            decoder->flush();
+            return;
+        }
+        if (decoder == nullptr)
+        {
+            bool rkmpp = decoderName.size() >= 6 && decoderName.compare(decoderName.size() - 6, 6, "_rkmpp") == 0;
+            decoder = getVideoDecoder(rkmpp ? CODEC_PLATFORM_RKMPP : CODEC_PLATFORM_FFMPEG);
+        }
+        decoder->setOutputFormat(outputFormat);
+        // the pool provides the parallelism, one decoding thread per stream
+        decoder->setThreads(1);
+        int ret = decoderName == "auto" ?
+            decoder->open_codec(p.width, p.height, p.fps, p.codec) :
+            decoder->open_codec(p.width, p.height, p.fps, decoderName);
+        decoderOpened = ret >= 0;
+        codec = p.codec;
+        if (!decoderOpened)
+        {
+            // packets are skipped until the stream is opened again
+            std::cerr << "StreamGroup: cannot open video decoder of " << url << std::endl;
+        }
+    }
+
+    // decoding side, false when the queue is empty
+    bool decode()
+    {
+        GroupPacket p;
+        for (int i = 0; i < STREAM_GROUP_PACKETS_PER_TURN && !removed; i++)
+        {
+            if (!queue.pop(p))
+            {
+                return false;
+            }
+            if (p.type == GROUP_OPENED)
+            {
+                openDecoder(p);
+                continue;
+            }
+            if (p.type == GROUP_END)
+            {
+                if (decoderOpened)
+                {
+                    decoder->sendPacket(nullptr, 0);
+                    deliver();
+                }
+                finished = true;
+                continue;
+            }
+            if (!decoderOpened)
+            {
+                continue;
+            }
+            int ret = decoder->sendPacket(p.packet.data, p.packet.size, p.packet.pts, p.packet.dts);
+            if (ret < 0)
+            {
+                // the decoder resyncs at the next keyframe, logged at 1, 2, 4, ... errors
+                decodeErrors++;
+                if ((decodeErrors & (decodeErrors - 1)) == 0)
+                {
+                    std::cerr << "StreamGroup: decode error " << ret << " in " << url << ", "
+                              << decodeErrors << " so far" << std::endl;
+                }
+            }
+            deliver();
+        }
+        return queue.size() > 0;
+    }
+};
+
+struct StreamGroup::Impl
+{
+    int threads = 1;
+    int outputFormat = VIDEO_FRAME_BGR;
+    int nextId = 0;
+    bool running = false;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::map<int, std::shared_ptr<GroupSource>> sources;
+    // sources with queued packets, each at most once, so only one worker handles it at a time
+    std::deque<std::shared_ptr<GroupSource>> ready;
+    std::vector<std::thread> workers;
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (running)
+        {
+            if (ready.empty())
+            {
+                cond.wait(lock);
+                continue;
+            }
+            std::shared_ptr<GroupSource> src = ready.front();
+            ready.pop_front();
+            lock.unlock();
+
+            bool more = src->decode();
+            if (!more)
+            {
+                // the reader may have pushed after the last pop, then it saw queued still set
+                src->queued = false;
+                more = src->queue.size() > 0 && !src->queued.exchange(true);
+            }
+
+            lock.lock();
+            if (src->removed)
+            {
+                // released outside the lock
+                lock.unlock();
+                src.reset();
+                lock.lock();
+                continue;
+            }
+            if (more)
+            {
+                // behind the other ready sources
+                ready.push_back(src);
+            }
+        }
+    }
+};
+
+
+StreamGroup::StreamGroup(int threads)
+{
+    impl_ = new Impl();
+    if (threads <= 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    impl_->threads = threads;
+}
+
+StreamGroup::~StreamGroup()
+{
+    stop();
+    delete impl_;
+    impl_ = nullptr;
+}
+
+int StreamGroup::add(std::string url, FrameCallback callback, std::string decoder_name, StreamOpenOptions options)
+{
+    auto src = std::make_shared<GroupSource>();
+    src->url = url;
+    src->decoderName = decoder_name.empty() ? "auto" : decoder_name;
+    src->callback = callback;
+    // a dead camera must not hold its reader forever
+    if (options.readTimeout <= 0)
+    {
+        options.readTimeout = 5000000;
+    }
+    if (options.openTimeout <= 0)
+    {
+        options.openTimeout = 5000000;
+    }
+    src->options = options;
+    Impl* impl = impl_;
+    GroupSource* raw = src.get();
+    src->ready = [impl, raw]() {
+        if (!raw->queued.exchange(true))
+        {
+            std::lock_guard<std::mutex> lock(impl->mtx);
+            // still listed, remove() joins the reader before the source can go away
+            auto it = impl->sources.find(raw->id);
+            if (it != impl->sources.end())
+            {
+                impl->ready.push_back(it->second);
+                impl->cond.notify_one();
+            }
+        }
+    };
+
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    src->id = impl_->nextId++;
+    src->outputFormat = impl_->outputFormat;
+    impl_->sources[src->id] = src;
+    if (impl_->running)
+    {
+        src->startReader();
+    }
+    return src->id;
+}
+
+bool StreamGroup::remove(int id)
+{
+    std::shared_ptr<GroupSource> src;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mtx);
+        auto it = impl_->sources.find(id);
+        if (it == impl_->sources.end())
+        {
+            return false;
+        }
+        src = it->second;
+        impl_->sources.erase(it);
+        src->removed = true;
+        auto r = std::find(impl_->ready.begin(), impl_->ready.end(), src);
+        if (r != impl_->ready.end())
+        {
+            impl_->ready.erase(r);
+        }
+    }
+    // the reader takes the lock in ready(), joined outside it
+    src->stopReader(true);
+    // closed here, or by the worker decoding it right now
+    return true;
+}
+
+void StreamGroup::setOutputFormat(int format)
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    impl_->outputFormat = format;
+}
+
+void StreamGroup::start()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    if (impl_->running)
+    {
+        return;
+    }
+    impl_->running = true;
+    for (int i = 0; i < impl_->threads; i++)
+    {
+        impl_->workers.emplace_back(&Impl::worker, impl_);
+    }
+    for (auto& src: impl_->sources)
+    {
+        src.second->startReader();
+    }
+}
+
+void StreamGroup::stop()
+{
+    std::vector<std::shared_ptr<GroupSource>> sources;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mtx);
+        if (!impl_->running)
+        {
+            return;
+        }
+        impl_->running = false;
+        impl_->cond.notify_all();
+        for (auto& src: impl_->sources)
+        {
+            sources.push_back(src.second);
+        }
+    }
+    for (auto& t: impl_->workers)
+    {
+        t.join();
+    }
+    impl_->workers.clear();
+    // reads of files end on their own, live streams may block until readTimeout
+    for (auto& src: sources)
+    {
+        src->stopReader(!src->isFile());
+    }
+    // packets left in the queues are decoded after the next start
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    impl_->ready.clear();
+    for (auto& src: impl_->sources)
+    {
+        if (src.second->queue.size() > 0)
+        {
+            src.second->queued = true;
+            impl_->ready.push_back(src.second);
+        }
+        else
+        {
+            src.second->queued = false;
+        }
+    }
+}
+
+int StreamGroup::threads()
+{
+    return impl_->threads;
+}
+
+size_t StreamGroup::size()
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->sources.size();
+}
+
+int64_t StreamGroup::frames(int id)
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    auto it = impl_->sources.find(id);
+    if (it == impl_->sources.end())
+    {
+        return -1;
+    }
+    return it->second->frames;
+}
+
+bool StreamGroup::finished(int id)
+{
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    auto it = impl_->sources.find(id);
+    return it != impl_->sources.end() && it->second->finished;
+}
+
+#endif
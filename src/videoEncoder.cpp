@@ -2,6 +2,7 @@
 #define FFMPEG_ENCODER_CPP
 
 #include "easyvideo/videoEncoder.h"
+#include "easyvideo/utils/yuv2bgr.h"
 // #include "pylike/str.h"
 
 extern "C"
@@ -48,6 +49,7 @@ struct VideoEncoder::Impl
     std::string codec_name;
 
     cv::Mat padFrame;
+    cv::Mat yuvFrame;
     
     // function
     AVFrame *CVMatToAVFrame(cv::Mat &inMatV, int YUV_TYPE);
@@ -70,17 +72,25 @@ AVFrame *VideoEncoder::Impl::CVMatToAVFrame(cv::Mat &inMat, int YUV_TYPE)
         return nullptr;
     }
 
+    bool isYUV = YUV_TYPE == VIDEO_FRAME_I420 || YUV_TYPE == VIDEO_FRAME_NV12;
+    int imgWidth = inMat.cols;
+    int imgHeight = isYUV ? inMat.rows * 2 / 3 : inMat.rows;
+    if (isYUV && (inMat.type() != CV_8UC1 || !inMat.isContinuous()))
+    {
+        std::cerr << "yuv input should be a continuous CV_8UC1 mat with height * 3 / 2 rows" << std::endl;
+        return nullptr;
+    }
+
     int width, height;
     if (useMPP)
     {
-        inMat.copyTo(padFrame(cv::Rect(0, 0, inMat.cols, inMat.rows)));
         width = padFrame.cols;
         height = padFrame.rows;
     }
     else
     {
-        width = inMat.cols;
-        height = inMat.rows;
+        width = imgWidth;
+        height = imgHeight;
     }
 
     //得到Mat信息
@@ -96,28 +106,58 @@ AVFrame *VideoEncoder::Impl::CVMatToAVFrame(cv::Mat &inMat, int YUV_TYPE)
     int ret = av_frame_get_buffer(frame, 64);
     if (ret < 0)
     {
+        av_frame_free(&frame);
         return nullptr;
     }
     ret = av_frame_make_writable(frame);
     if (ret < 0)
     {
+        av_frame_free(&frame);
         return nullptr;
     }
 
+    if (isYUV)
+    {
+        // already yuv, no color conversion
+        if (width != imgWidth || height != imgHeight)
+        {
+            // mpp aligned size, pad with the same gray as padFrame
+            memset(frame->data[0], 114, frame->linesize[0] * height);
+            memset(frame->data[1], 128, frame->linesize[1] * height / 2);
+            memset(frame->data[2], 128, frame->linesize[2] * height / 2);
+        }
+        easyvideo::splitYUV420(
+            inMat.data, imgWidth, imgHeight, YUV_TYPE == VIDEO_FRAME_NV12,
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->data[2], frame->linesize[2]
+        );
+        return frame;
+    }
+
     //转换颜色空间为YUV420
-    cv::cvtColor(useMPP?padFrame:inMat, inMat, cv::COLOR_BGR2YUV_I420);
+    if (useMPP)
+    {
+        inMat.copyTo(padFrame(cv::Rect(0, 0, inMat.cols, inMat.rows)));
+    }
+    cv::cvtColor(useMPP?padFrame:inMat, yuvFrame, cv::COLOR_BGR2YUV_I420);
 
     //按YUV420格式，设置数据地址
-    int frame_size = width * height;
-    unsigned char *data = inMat.data;
-
-    memcpy(frame->data[0], data, frame_size);
-    memcpy(frame->data[1], data + frame_size, frame_size/4);
-    memcpy(frame->data[2], data + frame_size * 5/4, frame_size/4);
+    easyvideo::splitYUV420(
+        yuvFrame.data, width, height, false,
+        frame->data[0], frame->linesize[0],
+        frame->data[1], frame->linesize[1],
+        frame->data[2], frame->linesize[2]
+    );
 
     return frame;
 }
 
+void VideoEncoder::setInputFormat(int format)
+{
+    input_format_ = format;
+}
+
 int VideoEncoder::encodeFrame(cv::Mat &frame, void* packet)
 {
     if(!impl_->isInit)
@@ -125,7 +165,11 @@ int VideoEncoder::encodeFrame(cv::Mat &frame, void* packet)
         std::cerr << "encoder not init!" << std::endl;
         return -1;
     }
-    AVFrame *yuv = impl_->CVMatToAVFrame(frame, 0);
+    AVFrame *yuv = impl_->CVMatToAVFrame(frame, input_format_);
+    if (yuv == nullptr)
+    {
+        return -1;
+    }
 
     AVPacket* pack = (AVPacket*)packet;
 
@@ -160,7 +204,11 @@ int VideoEncoder::encodeFrame(cv::Mat &frame, uint8_t *outData, int &outLen)
         std::cerr << "encoder not init!" << std::endl;
         return -1;
     }
-    AVFrame *yuv = impl_->CVMatToAVFrame(frame, 0);
+    AVFrame *yuv = impl_->CVMatToAVFrame(frame, input_format_);
+    if (yuv == nullptr)
+    {
+        return -1;
+    }
     AVPacket pack;
     memset(&pack, 0, sizeof(pack));
 
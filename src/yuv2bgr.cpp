@@ -0,0 +1,659 @@
+#ifndef EASYVIDEO_YUV2BGR_CPP
+#define EASYVIDEO_YUV2BGR_CPP
+
+#include "easyvideo/utils/yuv2bgr.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV2BGR_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+#define YUV2BGR_NEON
+#include <arm_neon.h>
+#endif
+
+// ITU-R BT.601 limited range, every term is kept in int16 with 6 fraction bits:
+// term = ((x << 7) * C + (1 << 14)) >> 15, the same as _mm_mulhrs_epi16 / vqrdmulhq_s16
+#define YUV2BGR_CY   19071  // 1.164 * 64 * 256
+#define YUV2BGR_CRV  26149  // 1.596 * 64 * 256
+#define YUV2BGR_CGU  6406   // 0.391 * 64 * 256
+#define YUV2BGR_CGV  13320  // 0.813 * 64 * 256
+#define YUV2BGR_CBU  16531  // 2.018 * 64 * 256 / 2, added twice to fit in int16
+
+typedef void (*YUV2BGRRowFunc)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int width);
+
+// ------------------------------------- scalar -------------------------------------
+
+static inline int sat16(int v)
+{
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+}
+
+static inline int mulhrs16(int a, int b)
+{
+    return (a * b + 0x4000) >> 15;
+}
+
+static inline uint8_t packus(int v)
+{
+    v = sat16(v + 32) >> 6;
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// uv_step is 1 for planar u/v and 2 for interleaved (NV12) chroma
+template <int uv_step>
+static void rowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int width)
+{
+    for (int j = 0; j < width; j++)
+    {
+        // * 128 rather than << 7, the differences can be negative
+        int uu = (u[(j >> 1) * uv_step] - 128) * 128;
+        int vv = (v[(j >> 1) * uv_step] - 128) * 128;
+        int yy = mulhrs16((y[j] - 16) * 128, YUV2BGR_CY);
+        int ub = mulhrs16(uu, YUV2BGR_CBU);
+
+        bgr[3 * j + 0] = packus(sat16(sat16(yy + ub) + ub));
+        bgr[3 * j + 1] = packus(sat16(sat16(yy - mulhrs16(uu, YUV2BGR_CGU)) - mulhrs16(vv, YUV2BGR_CGV)));
+        bgr[3 * j + 2] = packus(sat16(yy + mulhrs16(vv, YUV2BGR_CRV)));
+    }
+}
+
+// ------------------------------------- x86 -------------------------------------
+
+#ifdef YUV2BGR_X86
+
+// y: 8 luma in int16, u/v: 8 chroma in int16 already duplicated per pixel pair
+__attribute__((target("sse4.1")))
+static inline void yuv2bgr8_sse(__m128i y, __m128i u, __m128i v, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128), c32 = _mm_set1_epi16(32);
+    y = _mm_mulhrs_epi16(_mm_slli_epi16(_mm_sub_epi16(y, c16), 7), _mm_set1_epi16(YUV2BGR_CY));
+    u = _mm_slli_epi16(_mm_sub_epi16(u, c128), 7);
+    v = _mm_slli_epi16(_mm_sub_epi16(v, c128), 7);
+
+    __m128i ub = _mm_mulhrs_epi16(u, _mm_set1_epi16(YUV2BGR_CBU));
+    b = _mm_adds_epi16(_mm_adds_epi16(y, ub), ub);
+    g = _mm_subs_epi16(_mm_subs_epi16(y, _mm_mulhrs_epi16(u, _mm_set1_epi16(YUV2BGR_CGU))),
+                       _mm_mulhrs_epi16(v, _mm_set1_epi16(YUV2BGR_CGV)));
+    r = _mm_adds_epi16(y, _mm_mulhrs_epi16(v, _mm_set1_epi16(YUV2BGR_CRV)));
+
+    b = _mm_srai_epi16(_mm_adds_epi16(b, c32), 6);
+    g = _mm_srai_epi16(_mm_adds_epi16(g, c32), 6);
+    r = _mm_srai_epi16(_mm_adds_epi16(r, c32), 6);
+}
+
+// interleave 16 b, g, r bytes into 48 bytes of packed bgr
+__attribute__((target("sse4.1")))
+static inline void storeBGR16_sse(uint8_t* dst, __m128i b, __m128i g, __m128i r)
+{
+    const __m128i mb0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i mg0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i mr0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i mb1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i mg1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i mr1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i mb2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i mg2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i mr2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, mb0), _mm_shuffle_epi8(g, mg0)), _mm_shuffle_epi8(r, mr0));
+    __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, mb1), _mm_shuffle_epi8(g, mg1)), _mm_shuffle_epi8(r, mr1));
+    __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, mb2), _mm_shuffle_epi8(g, mg2)), _mm_shuffle_epi8(r, mr2));
+    _mm_storeu_si128((__m128i*)dst, o0);
+    _mm_storeu_si128((__m128i*)(dst + 16), o1);
+    _mm_storeu_si128((__m128i*)(dst + 32), o2);
+}
+
+// load 8 chroma samples as int16
+template <int uv_step>
+__attribute__((target("sse4.1")))
+static inline void loadUV8_sse(const uint8_t* u, const uint8_t* v, __m128i& uu, __m128i& vv)
+{
+    if (uv_step == 1)
+    {
+        uu = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)u));
+        vv = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)v));
+    }
+    else
+    {
+        // u points to the interleaved uv plane
+        __m128i uv = _mm_loadu_si128((const __m128i*)u);
+        uu = _mm_and_si128(uv, _mm_set1_epi16(0xff));
+        vv = _mm_srli_epi16(uv, 8);
+    }
+}
+
+template <int uv_step>
+__attribute__((target("sse4.1")))
+static void rowSSE41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int width)
+{
+    int j = 0;
+    for (; j + 16 <= width; j += 16)
+    {
+        __m128i y8 = _mm_loadu_si128((const __m128i*)(y + j));
+        __m128i uu, vv;
+        loadUV8_sse<uv_step>(u + (j >> 1) * uv_step, v + (j >> 1) * uv_step, uu, vv);
+
+        __m128i b0, g0, r0, b1, g1, r1;
+        yuv2bgr8_sse(_mm_cvtepu8_epi16(y8), _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv), b0, g0, r0);
+        yuv2bgr8_sse(_mm_cvtepu8_epi16(_mm_srli_si128(y8, 8)), _mm_unpackhi_epi16(uu, uu), _mm_unpackhi_epi16(vv, vv), b1, g1, r1);
+
+        storeBGR16_sse(bgr + 3 * j, _mm_packus_epi16(b0, b1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(r0, r1));
+    }
+    if (j < width)
+    {
+        rowScalar<uv_step>(y + j, u + (j >> 1) * uv_step, v + (j >> 1) * uv_step, bgr + 3 * j, width - j);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void yuv2bgr16_avx2(__m256i y, __m256i u, __m256i v, __m256i& b, __m256i& g, __m256i& r)
+{
+    const __m256i c16 = _mm256_set1_epi16(16), c128 = _mm256_set1_epi16(128), c32 = _mm256_set1_epi16(32);
+    y = _mm256_mulhrs_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y, c16), 7), _mm256_set1_epi16(YUV2BGR_CY));
+    u = _mm256_slli_epi16(_mm256_sub_epi16(u, c128), 7);
+    v = _mm256_slli_epi16(_mm256_sub_epi16(v, c128), 7);
+
+    __m256i ub = _mm256_mulhrs_epi16(u, _mm256_set1_epi16(YUV2BGR_CBU));
+    b = _mm256_adds_epi16(_mm256_adds_epi16(y, ub), ub);
+    g = _mm256_subs_epi16(_mm256_subs_epi16(y, _mm256_mulhrs_epi16(u, _mm256_set1_epi16(YUV2BGR_CGU))),
+                          _mm256_mulhrs_epi16(v, _mm256_set1_epi16(YUV2BGR_CGV)));
+    r = _mm256_adds_epi16(y, _mm256_mulhrs_epi16(v, _mm256_set1_epi16(YUV2BGR_CRV)));
+
+    b = _mm256_srai_epi16(_mm256_adds_epi16(b, c32), 6);
+    g = _mm256_srai_epi16(_mm256_adds_epi16(g, c32), 6);
+    r = _mm256_srai_epi16(_mm256_adds_epi16(r, c32), 6);
+}
+
+// 8 chroma samples as int16 -> 16 samples, each one duplicated for a pixel pair
+__attribute__((target("avx2")))
+static inline __m256i dupUV16_avx2(__m128i c)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(c, c)), _mm_unpackhi_epi16(c, c), 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i packus_avx2(__m256i lo, __m256i hi)
+{
+    // _mm256_packus_epi16 works per 128 bit lane, restore the pixel order
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+}
+
+template <int uv_step>
+__attribute__((target("avx2")))
+static void rowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int width)
+{
+    int j = 0;
+    for (; j + 32 <= width; j += 32)
+    {
+        __m256i y8 = _mm256_loadu_si256((const __m256i*)(y + j));
+        __m128i u0, v0, u1, v1;
+        loadUV8_sse<uv_step>(u + (j >> 1) * uv_step, v + (j >> 1) * uv_step, u0, v0);
+        loadUV8_sse<uv_step>(u + ((j >> 1) + 8) * uv_step, v + ((j >> 1) + 8) * uv_step, u1, v1);
+
+        __m256i b0, g0, r0, b1, g1, r1;
+        yuv2bgr16_avx2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y8)), dupUV16_avx2(u0), dupUV16_avx2(v0), b0, g0, r0);
+        yuv2bgr16_avx2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(y8, 1)), dupUV16_avx2(u1), dupUV16_avx2(v1), b1, g1, r1);
+
+        __m256i b = packus_avx2(b0, b1), g = packus_avx2(g0, g1), r = packus_avx2(r0, r1);
+        storeBGR16_sse(bgr + 3 * j, _mm256_castsi256_si128(b), _mm256_castsi256_si128(g), _mm256_castsi256_si128(r));
+        storeBGR16_sse(bgr + 3 * j + 48, _mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(r, 1));
+    }
+    if (j < width)
+    {
+        rowSSE41<uv_step>(y + j, u + (j >> 1) * uv_step, v + (j >> 1) * uv_step, bgr + 3 * j, width - j);
+    }
+}
+
+#endif  // YUV2BGR_X86
+
+// ------------------------------------- arm -------------------------------------
+
+#ifdef YUV2BGR_NEON
+
+template <int uv_step>
+static void rowNEON(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int width)
+{
+    const int16x8_t c16 = vdupq_n_s16(16), c128 = vdupq_n_s16(128);
+    const int16x8_t cy = vdupq_n_s16(YUV2BGR_CY), crv = vdupq_n_s16(YUV2BGR_CRV), cbu = vdupq_n_s16(YUV2BGR_CBU);
+    const int16x8_t cgu = vdupq_n_s16(YUV2BGR_CGU), cgv = vdupq_n_s16(YUV2BGR_CGV);
+
+    int j = 0;
+    for (; j + 16 <= width; j += 16)
+    {
+        uint8x16_t y8 = vld1q_u8(y + j);
+        uint8x8_t u8, v8;
+        if (uv_step == 1)
+        {
+            u8 = vld1_u8(u + (j >> 1));
+            v8 = vld1_u8(v + (j >> 1));
+        }
+        else
+        {
+            uint8x8x2_t uv = vld2_u8(u + j);
+            u8 = uv.val[0];
+            v8 = uv.val[1];
+        }
+        uint8x8x2_t uz = vzip_u8(u8, u8), vz = vzip_u8(v8, v8);
+
+        uint8x8x3_t out[2];
+        for (int k = 0; k < 2; k++)
+        {
+            int16x8_t yy = vreinterpretq_s16_u16(vmovl_u8(k ? vget_high_u8(y8) : vget_low_u8(y8)));
+            int16x8_t uu = vreinterpretq_s16_u16(vmovl_u8(uz.val[k]));
+            int16x8_t vv = vreinterpretq_s16_u16(vmovl_u8(vz.val[k]));
+            yy = vqrdmulhq_s16(vshlq_n_s16(vsubq_s16(yy, c16), 7), cy);
+            uu = vshlq_n_s16(vsubq_s16(uu, c128), 7);
+            vv = vshlq_n_s16(vsubq_s16(vv, c128), 7);
+
+            int16x8_t ub = vqrdmulhq_s16(uu, cbu);
+            out[k].val[0] = vqrshrun_n_s16(vqaddq_s16(vqaddq_s16(yy, ub), ub), 6);
+            out[k].val[1] = vqrshrun_n_s16(vqsubq_s16(vqsubq_s16(yy, vqrdmulhq_s16(uu, cgu)), vqrdmulhq_s16(vv, cgv)), 6);
+            out[k].val[2] = vqrshrun_n_s16(vqaddq_s16(yy, vqrdmulhq_s16(vv, crv)), 6);
+        }
+        uint8x16x3_t o;
+        o.val[0] = vcombine_u8(out[0].val[0], out[1].val[0]);
+        o.val[1] = vcombine_u8(out[0].val[1], out[1].val[1]);
+        o.val[2] = vcombine_u8(out[0].val[2], out[1].val[2]);
+        vst3q_u8(bgr + 3 * j, o);
+    }
+    if (j < width)
+    {
+        rowScalar<uv_step>(y + j, u + (j >> 1) * uv_step, v + (j >> 1) * uv_step, bgr + 3 * j, width - j);
+    }
+}
+
+#endif  // YUV2BGR_NEON
+
+// ------------------------------------- dispatch -------------------------------------
+
+static std::atomic<int> yuv2bgr_kernel(easyvideo::YUV2BGR_KERNEL_AUTO);
+
+bool easyvideo::isYUV2BGRKernelSupported(int kernel)
+{
+    switch (kernel)
+    {
+    case YUV2BGR_KERNEL_AUTO:
+    case YUV2BGR_KERNEL_SCALAR:
+        return true;
+#ifdef YUV2BGR_X86
+    case YUV2BGR_KERNEL_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case YUV2BGR_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef YUV2BGR_NEON
+    case YUV2BGR_KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static int selectBestKernel()
+{
+    const int candidates[] = {
+        easyvideo::YUV2BGR_KERNEL_AVX2,
+        easyvideo::YUV2BGR_KERNEL_SSE41,
+        easyvideo::YUV2BGR_KERNEL_NEON
+    };
+    for (int kernel: candidates)
+    {
+        if (easyvideo::isYUV2BGRKernelSupported(kernel)) return kernel;
+    }
+    return easyvideo::YUV2BGR_KERNEL_SCALAR;
+}
+
+bool easyvideo::setYUV2BGRKernel(int kernel)
+{
+    if (!isYUV2BGRKernelSupported(kernel))
+    {
+        return false;
+    }
+    yuv2bgr_kernel = (kernel == YUV2BGR_KERNEL_AUTO) ? selectBestKernel() : kernel;
+    return true;
+}
+
+int easyvideo::getYUV2BGRKernel()
+{
+    int kernel = yuv2bgr_kernel;
+    if (kernel == YUV2BGR_KERNEL_AUTO)
+    {
+        kernel = selectBestKernel();
+        yuv2bgr_kernel = kernel;
+    }
+    return kernel;
+}
+
+const char* easyvideo::getYUV2BGRKernelName(int kernel)
+{
+    switch (kernel)
+    {
+    case YUV2BGR_KERNEL_AUTO:   return "auto";
+    case YUV2BGR_KERNEL_SCALAR: return "scalar";
+    case YUV2BGR_KERNEL_SSE41:  return "sse4.1";
+    case YUV2BGR_KERNEL_AVX2:   return "avx2";
+    case YUV2BGR_KERNEL_NEON:   return "neon";
+    default:                    return "unknown";
+    }
+}
+
+template <int uv_step>
+static YUV2BGRRowFunc getRowFunc()
+{
+    switch (easyvideo::getYUV2BGRKernel())
+    {
+#ifdef YUV2BGR_X86
+    case easyvideo::YUV2BGR_KERNEL_AVX2:
+        return rowAVX2<uv_step>;
+    case easyvideo::YUV2BGR_KERNEL_SSE41:
+        return rowSSE41<uv_step>;
+#endif
+#ifdef YUV2BGR_NEON
+    case easyvideo::YUV2BGR_KERNEL_NEON:
+        return rowNEON<uv_step>;
+#endif
+    default:
+        return rowScalar<uv_step>;
+    }
+}
+
+void easyvideo::YUV420P2BGR(const uint8_t* y, int y_stride,
+                            const uint8_t* u, int u_stride,
+                            const uint8_t* v, int v_stride,
+                            uint8_t* bgr, int bgr_stride, int width, int height)
+{
+    YUV2BGRRowFunc row = getRowFunc<1>();
+    for (int i = 0; i < height; i++)
+    {
+        row(y + i * y_stride, u + (i >> 1) * u_stride, v + (i >> 1) * v_stride, bgr + i * bgr_stride, width);
+    }
+}
+
+void easyvideo::NV12_2_BGR(const uint8_t* y, int y_stride,
+                           const uint8_t* uv, int uv_stride,
+                           uint8_t* bgr, int bgr_stride, int width, int height)
+{
+    YUV2BGRRowFunc row = getRowFunc<2>();
+    for (int i = 0; i < height; i++)
+    {
+        const uint8_t* uv_row = uv + (i >> 1) * uv_stride;
+        row(y + i * y_stride, uv_row, uv_row + 1, bgr + i * bgr_stride, width);
+    }
+}
+
+void easyvideo::splitYUV420(const uint8_t* src, int width, int height, bool nv12,
+                            uint8_t* y, int y_stride,
+                            uint8_t* u, int u_stride,
+                            uint8_t* v, int v_stride)
+{
+    for (int i = 0; i < height; i++)
+    {
+        memcpy(y + i * y_stride, src + i * width, width);
+    }
+
+    int cw = width / 2, ch = height / 2;
+    const uint8_t* src_u = src + width * height;
+    const uint8_t* src_v = src_u + cw * ch;
+    for (int i = 0; i < ch; i++)
+    {
+        if (nv12)
+        {
+            const uint8_t* uv = src_u + i * 2 * cw;
+            uint8_t* dst_u = u + i * u_stride;
+            uint8_t* dst_v = v + i * v_stride;
+            for (int j = 0; j < cw; j++)
+            {
+                dst_u[j] = uv[2 * j];
+                dst_v[j] = uv[2 * j + 1];
+            }
+        }
+        else
+        {
+            memcpy(u + i * u_stride, src_u + i * cw, cw);
+            memcpy(v + i * v_stride, src_v + i * cw, cw);
+        }
+    }
+}
+
+// ------------------------------------- letterbox -------------------------------------
+
+// bilinear weights in 11 bits, the same as cv::resize INTER_LINEAR
+#define LETTERBOX_COEF_BITS 11
+#define LETTERBOX_COEF_ONE  (1 << LETTERBOX_COEF_BITS)
+#define LETTERBOX_PAD       114
+
+// source index pair and weight of the second one for every destination index,
+// dst i is sampled at (i + 0.5) * scale - 0.5
+static void buildLinearMap(int src_len, int dst_len, double scale, std::vector<int>& map)
+{
+    map.resize(dst_len * 3);
+    for (int i = 0; i < dst_len; i++)
+    {
+        double s = (i + 0.5) * scale - 0.5;
+        int s0 = (int)floor(s);
+        int w = (int)lround((s - s0) * LETTERBOX_COEF_ONE);
+        if (s0 < 0)
+        {
+            s0 = 0;
+            w = 0;
+        }
+        int s1 = s0 + 1;
+        if (s0 >= src_len - 1)
+        {
+            s0 = s1 = src_len - 1;
+            w = 0;
+        }
+        map[3 * i] = s0;
+        map[3 * i + 1] = s1;
+        map[3 * i + 2] = w;
+    }
+}
+
+// the bilinear filter is separable: two source rows are first blended vertically into an
+// int row (at most 255 << 11), contiguous and vectorized, then resampled horizontally.
+// nothing is rounded in between, so the result is exactly the one of the 2x2 filter
+#define LETTERBOX_ROUND (1 << (2 * LETTERBOX_COEF_BITS - 1))
+
+typedef void (*VerticalRowFunc)(const uint8_t* r0, const uint8_t* r1, int wy, int* dst, int width);
+
+static void verticalRowScalar(const uint8_t* r0, const uint8_t* r1, int wy, int* dst, int width)
+{
+    for (int j = 0; j < width; j++)
+    {
+        dst[j] = r0[j] * (LETTERBOX_COEF_ONE - wy) + r1[j] * wy;
+    }
+}
+
+// step 2 picks one channel of an interleaved uv row
+template <int step>
+static void horizontalRow(const int* mid, const int* xmap, uint8_t* dst, int width)
+{
+    for (int j = 0; j < width; j++, xmap += 3)
+    {
+        int v = mid[xmap[0] * step] * (LETTERBOX_COEF_ONE - xmap[2]) + mid[xmap[1] * step] * xmap[2];
+        dst[j] = (uint8_t)((v + LETTERBOX_ROUND) >> (2 * LETTERBOX_COEF_BITS));
+    }
+}
+
+#ifdef YUV2BGR_X86
+
+// r0/r1 bytes interleaved as int16 pairs, one madd gives r0 * (ONE - wy) + r1 * wy
+__attribute__((target("sse4.1")))
+static void verticalRowSSE41(const uint8_t* r0, const uint8_t* r1, int wy, int* dst, int width)
+{
+    const __m128i w = _mm_set1_epi32((wy << 16) | (LETTERBOX_COEF_ONE - wy));
+    const __m128i zero = _mm_setzero_si128();
+    int j = 0;
+    for (; j + 16 <= width; j += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(r0 + j));
+        __m128i b = _mm_loadu_si128((const __m128i*)(r1 + j));
+        __m128i lo = _mm_unpacklo_epi8(a, b), hi = _mm_unpackhi_epi8(a, b);
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+        _mm_storeu_si128((__m128i*)(dst + j + 4), _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+        _mm_storeu_si128((__m128i*)(dst + j + 8), _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+        _mm_storeu_si128((__m128i*)(dst + j + 12), _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+    }
+    verticalRowScalar(r0 + j, r1 + j, wy, dst + j, width - j);
+}
+
+__attribute__((target("avx2")))
+static void verticalRowAVX2(const uint8_t* r0, const uint8_t* r1, int wy, int* dst, int width)
+{
+    const __m256i w = _mm256_set1_epi32((wy << 16) | (LETTERBOX_COEF_ONE - wy));
+    int j = 0;
+    for (; j + 32 <= width; j += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(r0 + j));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(r1 + j));
+        for (int k = 0; k < 2; k++)
+        {
+            __m128i a8 = k ? _mm256_extracti128_si256(a, 1) : _mm256_castsi256_si128(a);
+            __m128i b8 = k ? _mm256_extracti128_si256(b, 1) : _mm256_castsi256_si128(b);
+            __m256i lo = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(a8, b8));
+            __m256i hi = _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(a8, b8));
+            _mm256_storeu_si256((__m256i*)(dst + j + 16 * k), _mm256_madd_epi16(lo, w));
+            _mm256_storeu_si256((__m256i*)(dst + j + 16 * k + 8), _mm256_madd_epi16(hi, w));
+        }
+    }
+    verticalRowScalar(r0 + j, r1 + j, wy, dst + j, width - j);
+}
+
+#endif  // YUV2BGR_X86
+
+#ifdef YUV2BGR_NEON
+
+static void verticalRowNEON(const uint8_t* r0, const uint8_t* r1, int wy, int* dst, int width)
+{
+    const uint16_t w0 = LETTERBOX_COEF_ONE - wy, w1 = wy;
+    int j = 0;
+    for (; j + 8 <= width; j += 8)
+    {
+        uint16x8_t a = vmovl_u8(vld1_u8(r0 + j)), b = vmovl_u8(vld1_u8(r1 + j));
+        uint32x4_t lo = vmlal_n_u16(vmull_n_u16(vget_low_u16(a), w0), vget_low_u16(b), w1);
+        uint32x4_t hi = vmlal_n_u16(vmull_n_u16(vget_high_u16(a), w0), vget_high_u16(b), w1);
+        vst1q_s32(dst + j, vreinterpretq_s32_u32(lo));
+        vst1q_s32(dst + j + 4, vreinterpretq_s32_u32(hi));
+    }
+    verticalRowScalar(r0 + j, r1 + j, wy, dst + j, width - j);
+}
+
+#endif  // YUV2BGR_NEON
+
+static VerticalRowFunc getVerticalFunc()
+{
+    switch (easyvideo::getYUV2BGRKernel())
+    {
+#ifdef YUV2BGR_X86
+    case easyvideo::YUV2BGR_KERNEL_AVX2:
+        return verticalRowAVX2;
+    case easyvideo::YUV2BGR_KERNEL_SSE41:
+        return verticalRowSSE41;
+#endif
+#ifdef YUV2BGR_NEON
+    case easyvideo::YUV2BGR_KERNEL_NEON:
+        return verticalRowNEON;
+#endif
+    default:
+        return verticalRowScalar;
+    }
+}
+
+template <int uv_step>
+static float letterboxYUV420(const uint8_t* y, int y_stride,
+                             const uint8_t* u, int u_stride,
+                             const uint8_t* v, int v_stride,
+                             int src_width, int src_height,
+                             uint8_t* bgr, int bgr_stride, int dst_width, int dst_height)
+{
+    float ratio = std::min(dst_width / (src_width * 1.0), dst_height / (src_height * 1.0));
+    int unpad_w = std::min((int)round(ratio * src_width), dst_width);
+    int unpad_h = std::min((int)round(ratio * src_height), dst_height);
+    int cw = (unpad_w + 1) / 2, ch = (unpad_h + 1) / 2;
+
+    // kept per thread, no allocation once the sizes are stable
+    thread_local std::vector<int> xmap, ymap, cxmap, cymap;
+    thread_local std::vector<uint8_t> rowbuf;
+    thread_local std::vector<int> midbuf;
+    double sx = src_width / (double)unpad_w, sy = src_height / (double)unpad_h;
+    buildLinearMap(src_width, unpad_w, sx, xmap);
+    buildLinearMap(src_height, unpad_h, sy, ymap);
+    // chroma of the destination pixel pair, measured on the source chroma plane
+    buildLinearMap((src_width + 1) / 2, cw, sx, cxmap);
+    buildLinearMap((src_height + 1) / 2, ch, sy, cymap);
+    rowbuf.resize(unpad_w + 2 * cw);
+    uint8_t* yrow = rowbuf.data();
+    uint8_t* urow = yrow + unpad_w;
+    uint8_t* vrow = urow + cw;
+    // one source row of luma, or of both chroma planes (interleaved ones for nv12)
+    int src_cw = (src_width + 1) / 2;
+    midbuf.resize(std::max(src_width, 2 * src_cw));
+    int* mid = midbuf.data();
+
+    YUV2BGRRowFunc row = getRowFunc<1>();
+    VerticalRowFunc vertical = getVerticalFunc();
+    for (int i = 0; i < unpad_h; i++)
+    {
+        const int* ym = &ymap[3 * i];
+        vertical(y + ym[0] * y_stride, y + ym[1] * y_stride, ym[2], mid, src_width);
+        horizontalRow<1>(mid, xmap.data(), yrow, unpad_w);
+
+        if (!(i & 1))
+        {
+            const int* cm = &cymap[3 * (i >> 1)];
+            if (uv_step == 2)
+            {
+                // v is u + 1 on the same row
+                vertical(u + cm[0] * u_stride, u + cm[1] * u_stride, cm[2], mid, 2 * src_cw);
+                horizontalRow<2>(mid, cxmap.data(), urow, cw);
+                horizontalRow<2>(mid + 1, cxmap.data(), vrow, cw);
+            }
+            else
+            {
+                vertical(u + cm[0] * u_stride, u + cm[1] * u_stride, cm[2], mid, src_cw);
+                horizontalRow<1>(mid, cxmap.data(), urow, cw);
+                vertical(v + cm[0] * v_stride, v + cm[1] * v_stride, cm[2], mid, src_cw);
+                horizontalRow<1>(mid, cxmap.data(), vrow, cw);
+            }
+        }
+
+        uint8_t* dst = bgr + i * bgr_stride;
+        row(yrow, urow, vrow, dst, unpad_w);
+        memset(dst + 3 * unpad_w, LETTERBOX_PAD, 3 * (dst_width - unpad_w));
+    }
+    for (int i = unpad_h; i < dst_height; i++)
+    {
+        memset(bgr + i * bgr_stride, LETTERBOX_PAD, 3 * dst_width);
+    }
+    return 1. / ratio;
+}
+
+float easyvideo::letterboxYUV420P2BGR(const uint8_t* y, int y_stride,
+                                      const uint8_t* u, int u_stride,
+                                      const uint8_t* v, int v_stride,
+                                      int src_width, int src_height,
+                                      uint8_t* bgr, int bgr_stride, int dst_width, int dst_height)
+{
+    return letterboxYUV420<1>(y, y_stride, u, u_stride, v, v_stride, src_width, src_height,
+                              bgr, bgr_stride, dst_width, dst_height);
+}
+
+float easyvideo::letterboxNV12_2_BGR(const uint8_t* y, int y_stride,
+                                     const uint8_t* uv, int uv_stride,
+                                     int src_width, int src_height,
+                                     uint8_t* bgr, int bgr_stride, int dst_width, int dst_height)
+{
+    return letterboxYUV420<2>(y, y_stride, uv, uv_stride, uv + 1, uv_stride, src_width, src_height,
+                              bgr, bgr_stride, dst_width, dst_height);
+}
+
+#endif  // EASYVIDEO_YUV2BGR_CPP
@@ -88,6 +88,7 @@ easyvideo::YUYV2BGRCapture::YUYV2BGRCapture(std::string source, int apiPreferenc
 bool easyvideo::YUYV2BGRCapture::open(std::string source, int apiPreference)
 {
     bool success = cap.open(source, apiPreference);
+    frame_id_ = 0;
     if(success)
     {
         cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
@@ -125,12 +126,22 @@ double easyvideo::YUYV2BGRCapture::get(int propId)
 }
 
 bool easyvideo::YUYV2BGRCapture::read(cv::Mat& image)
+{
+    Frame frame;
+    bool success = read(frame);
+    if (success) image = frame.image;
+    return success;
+}
+
+bool easyvideo::YUYV2BGRCapture::read(Frame& frame)
 {
     bool success = false;
+    double t0 = steadySeconds();
     // std::cout << "step: " << step << std::endl;
     for(int i=0;i<step;++i) success = cap.read(recvImage);
     if (success)
     {
+        double t1 = steadySeconds();
         if (first)
         {
             sz = recvImage.size();
@@ -144,11 +155,35 @@ bool easyvideo::YUYV2BGRCapture::read(cv::Mat& image)
 #else
         yuyv2bgr(recvImage.data, outImage.data, area);
 #endif
-        image = outImage;
+        frame.image = outImage;
+
+        // raw yuyv from the device, nothing to decode
+        frame.info = FrameInfo();
+        frame.info.recvTime = t1;
+        frame.info.demuxTime = (t1 - t0) * 1000.;
+        frame.info.convertTime = (steadySeconds() - t1) * 1000.;
+        frame.info.id = ++frame_id_;
+        frame.info.dropped = step > 1 ? step - 1 : 0;
     }
     return success;
 }
 
+bool easyvideo::YUYV2BGRCapture::readInto(cv::Mat& image)
+{
+    bool success = false;
+    for(int i=0;i<step;++i) success = cap.read(recvImage);
+    if (!success) return false;
+    // the converters write packed rows
+    if (!image.isContinuous()) image.release();
+    image.create(recvImage.size(), CV_8UC3);
+#ifdef ENABLE_RKMPP
+    yuyv2bgr_mpp(recvImage.data, recvImage.cols, recvImage.rows, image.data);
+#else
+    yuyv2bgr(recvImage.data, image.data, recvImage.cols * recvImage.rows);
+#endif
+    return true;
+}
+
 void easyvideo::YUYV2BGRCapture::operator>>(cv::Mat& image)
 {
     read(image);